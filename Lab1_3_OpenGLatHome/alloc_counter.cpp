@@ -0,0 +1,64 @@
+#include "alloc_counter.h"
+
+#ifdef LAB_COUNT_ALLOCATIONS
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<uint64_t> allocation_count{0};
+    std::atomic<uint64_t> allocation_bytes{0};
+
+    void* counted_allocate(std::size_t size)
+    {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+        allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+        if (void* ptr = std::malloc(size == 0 ? 1 : size))
+        {
+            return ptr;
+        }
+        throw std::bad_alloc();
+    }
+
+    void* counted_allocate_aligned(std::size_t size, std::align_val_t alignment)
+    {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+        allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+        const auto align = static_cast<std::size_t>(alignment);
+        const std::size_t rounded = (size + align - 1) / align * align;
+        if (void* ptr = std::aligned_alloc(align, rounded == 0 ? align : rounded))
+        {
+            return ptr;
+        }
+        throw std::bad_alloc();
+    }
+}
+
+void* operator new(std::size_t size) { return counted_allocate(size); }
+void* operator new[](std::size_t size) { return counted_allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return counted_allocate_aligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return counted_allocate_aligned(size, alignment); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+namespace alloc_counter
+{
+    bool enabled() { return true; }
+    uint64_t allocations() { return allocation_count.load(std::memory_order_relaxed); }
+    uint64_t bytes() { return allocation_bytes.load(std::memory_order_relaxed); }
+}
+#else
+namespace alloc_counter
+{
+    bool enabled() { return false; }
+    uint64_t allocations() { return 0; }
+    uint64_t bytes() { return 0; }
+}
+#endif
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+// Counts global operator new calls when the build defines
+// LAB_COUNT_ALLOCATIONS (CMake option of the same name); otherwise enabled()
+// is false and the counters stay at zero.
+namespace alloc_counter
+{
+    bool enabled();
+    uint64_t allocations();
+    uint64_t bytes();
+}
@@ -0,0 +1,408 @@
+// Kernel microbenchmarks: triangle setup and fill, texture sampling, Phong
+// fragments, vertex projection and OBJ loading. Every benchmark is warmed up
+// and calibrated so one sample lasts at least --sample-ms, then timed over
+// --samples samples; the report gives the median and minimum time per call,
+// the relative spread, and the throughput at the median.
+//
+// Run from the directory holding the bundled assets:
+//     Lab1_3_OpenGLatHome_bench [--filter TEXT] [--samples N] [--sample-ms MS]
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "geometry.h"
+#include "light.h"
+#include "model.h"
+#include "render_stats.h"
+#include "renderer.h"
+#include "shader.h"
+#include "texture.h"
+
+namespace
+{
+    constexpr int kWidth = 800;
+    constexpr int kHeight = 800;
+    const String kModelPath = "ImageToStl.com_gabriel_plush_ultrakill/gabriel_plush_ultrakill.obj";
+    const String kDiffuseTexturePath = "ImageToStl.com_gabriel_plush_ultrakill/3DModel_LowPoly_baseColor.png";
+    const std::array<String, 3> kLoadPaths{
+        kModelPath,
+        "carrot_soup/african_head.obj",
+        "carrot_soup/carrot_soup.obj"
+    };
+
+    struct BenchSettings
+    {
+        String filter;
+        int samples = 15;
+        double sample_ms = 20.0;
+        double warmup_ms = 100.0;
+    };
+
+    BenchSettings parse_settings(int argc, char** argv)
+    {
+        BenchSettings settings;
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string_view arg = argv[i];
+            if (arg == "--filter" && i + 1 < argc)
+            {
+                settings.filter = argv[++i];
+            }
+            else if (arg == "--samples" && i + 1 < argc)
+            {
+                settings.samples = std::max(1, std::stoi(argv[++i]));
+            }
+            else if (arg == "--sample-ms" && i + 1 < argc)
+            {
+                settings.sample_ms = std::stod(argv[++i]);
+            }
+            else
+            {
+                throw std::runtime_error("Unknown option: " + std::string(arg));
+            }
+        }
+        return settings;
+    }
+
+    // Results feed this so the optimizer cannot drop the benchmarked work.
+    volatile float sink = 0.0f;
+
+    using Clock = std::chrono::steady_clock;
+
+    double elapsed_ns(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+    class BenchRunner
+    {
+    public:
+        explicit BenchRunner(const BenchSettings& settings)
+            : settings_(settings)
+        {
+            std::cout << std::left << std::setw(40) << "benchmark" << std::right << std::setw(12) << "median"
+                << std::setw(12) << "min" << std::setw(9) << "spread" << std::setw(18) << "throughput" << "\n";
+        }
+
+        // `items` is the work done by one call of `body`, reported per second
+        // in `unit` (already scaled by `scale`, e.g. 1e6 for "M...").
+        void run(const String& name, double items, double scale, const char* unit, const std::function<void()>& body)
+        {
+            if (!settings_.filter.empty() && name.find(settings_.filter) == String::npos)
+            {
+                return;
+            }
+
+            // Doubles the calls per sample until a sample is long enough,
+            // then keeps running until the warmup time is used up.
+            const double sample_ns = settings_.sample_ms * 1e6;
+            const Clock::time_point warmup_start = Clock::now();
+            long calls = 1;
+            while (true)
+            {
+                const Clock::time_point start = Clock::now();
+                for (long i = 0; i < calls; ++i)
+                {
+                    body();
+                }
+                if (elapsed_ns(start) >= sample_ns)
+                {
+                    break;
+                }
+                calls *= 2;
+            }
+            while (elapsed_ns(warmup_start) < settings_.warmup_ms * 1e6)
+            {
+                body();
+            }
+
+            std::vector<double> per_call(settings_.samples);
+            for (double& ns : per_call)
+            {
+                const Clock::time_point start = Clock::now();
+                for (long i = 0; i < calls; ++i)
+                {
+                    body();
+                }
+                ns = elapsed_ns(start) / static_cast<double>(calls);
+            }
+
+            std::sort(per_call.begin(), per_call.end());
+            const double median = per_call[per_call.size() / 2];
+            double mean = 0.0;
+            for (const double ns : per_call)
+            {
+                mean += ns;
+            }
+            mean /= static_cast<double>(per_call.size());
+            double variance = 0.0;
+            for (const double ns : per_call)
+            {
+                variance += (ns - mean) * (ns - mean);
+            }
+            const double spread = std::sqrt(variance / static_cast<double>(per_call.size())) / mean;
+
+            std::ostringstream throughput;
+            throughput << std::fixed << std::setprecision(2) << items / median * 1e9 / scale << " " << unit;
+            std::cout << std::left << std::setw(40) << name << std::right << std::setw(12) << format_time(median)
+                << std::setw(12) << format_time(per_call.front()) << std::setw(8) << std::fixed
+                << std::setprecision(1) << spread * 100.0 << "%" << std::setw(18) << throughput.str() << std::endl;
+        }
+
+    private:
+        static String format_time(double ns)
+        {
+            std::ostringstream out;
+            out << std::fixed << std::setprecision(2);
+            if (ns < 1e3)
+            {
+                out << ns << " ns";
+            }
+            else if (ns < 1e6)
+            {
+                out << ns / 1e3 << " us";
+            }
+            else
+            {
+                out << ns / 1e6 << " ms";
+            }
+            return out.str();
+        }
+
+        BenchSettings settings_;
+    };
+
+    // Constant colour, so raster benchmarks measure setup, traversal and
+    // depth rather than lighting.
+    class FlatShader : public IShader
+    {
+    public:
+        Vec4f vertex(int, int) override { return {}; }
+        bool fragment(const Vec3f&, const Vec2i&, Vec3f& color) override
+        {
+            color = Vec3f(0.8f, 0.5f, 0.2f);
+            return false;
+        }
+        [[nodiscard]] bool may_discard() const override { return false; }
+    };
+
+    // Stacks `count` right triangles with legs of `size` pixels, each nearer
+    // than the last so every covered pixel passes the depth test and is
+    // shaded.
+    std::function<void()> stacked_triangles(Framebuffer& framebuffer, FlatShader& shader, float size, int count)
+    {
+        return [&framebuffer, &shader, size, count]
+        {
+            framebuffer.clear();
+            const float x0 = (kWidth - size) * 0.5f + 0.25f;
+            const float y0 = (kHeight - size) * 0.5f + 0.25f;
+            for (int i = 0; i < count; ++i)
+            {
+                const float z = static_cast<float>(i + 1) / static_cast<float>(count + 1);
+                const std::array<Vec4f, 3> screen_vertices{
+                    Vec4f(x0, y0, z, 1.0f),
+                    Vec4f(x0 + size, y0, z, 1.0f),
+                    Vec4f(x0, y0 + size, z, 1.0f)
+                };
+                renderer::barycentric_triangle(screen_vertices, framebuffer.color, framebuffer.depth, shader);
+            }
+        };
+    }
+
+    void raster_benchmarks(BenchRunner& runner)
+    {
+        constexpr int kTriangles = 256;
+        Framebuffer framebuffer(kWidth, kHeight);
+        FlatShader shader;
+
+        const std::function<void()> setup = stacked_triangles(framebuffer, shader, 2.0f, kTriangles);
+        runner.run("raster/setup 2px", kTriangles, 1e6, "Mtri/s", setup);
+
+        for (const float size : {8.0f, 32.0f, 128.0f, 512.0f})
+        {
+            // About a million pixels per call at most.
+            const int count = std::clamp(static_cast<int>((1 << 21) / (size * size)), 4, kTriangles);
+            const std::function<void()> fill = stacked_triangles(framebuffer, shader, size, count);
+            RenderStats stats;
+            {
+                const RenderStats::Scope scope(stats);
+                fill();
+            }
+            std::ostringstream name;
+            name << "raster/fill " << static_cast<int>(size) << "px";
+            runner.run(name.str(), static_cast<double>(stats.pixels_shaded), 1e6, "Mpix/s", fill);
+        }
+    }
+
+    std::vector<Vec2f> random_uvs(size_t count)
+    {
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<Vec2f> uvs(count);
+        for (Vec2f& uv : uvs)
+        {
+            uv = Vec2f(unit(rng), unit(rng));
+        }
+        return uvs;
+    }
+
+    void texture_benchmarks(BenchRunner& runner)
+    {
+        const std::vector<Vec2f> uvs = random_uvs(4096);
+        // Neighbouring pixels of one textured span.
+        std::vector<Vec2f> span_uvs(uvs.size());
+        for (size_t i = 0; i < span_uvs.size(); ++i)
+        {
+            span_uvs[i] = Vec2f(0.25f + static_cast<float>(i % 256) / 1024.0f, 0.5f + static_cast<float>(i / 256) / 1024.0f);
+        }
+
+        TextureOptions bc1;
+        bc1.format = TextureFormat::BC1;
+        const Texture rgb8_texture(kDiffuseTexturePath);
+        const Texture bc1_texture(kDiffuseTexturePath, bc1);
+
+        auto sample_all = [](const Texture& texture, const std::vector<Vec2f>& points)
+        {
+            return [&texture, &points]
+            {
+                Vec3f sum;
+                for (const Vec2f& uv : points)
+                {
+                    sum += texture.sample(uv);
+                }
+                sink = sink + sum.x;
+            };
+        };
+        const double count = static_cast<double>(uvs.size());
+        runner.run("texture/rgb8 random", count, 1e6, "Msample/s", sample_all(rgb8_texture, uvs));
+        runner.run("texture/rgb8 span", count, 1e6, "Msample/s", sample_all(rgb8_texture, span_uvs));
+        runner.run("texture/bc1 random", count, 1e6, "Msample/s", sample_all(bc1_texture, uvs));
+        runner.run("texture/bc1 span", count, 1e6, "Msample/s", sample_all(bc1_texture, span_uvs));
+    }
+
+    Camera default_camera()
+    {
+        return Camera(Vec3f(0.0f, 0.5f, 0.3f), Vec3f(0.0f, 0.2f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f), 60.0f,
+                      static_cast<float>(kWidth) / static_cast<float>(kHeight), 0.1f, 100.0f, kWidth, kHeight);
+    }
+
+    void shading_benchmarks(BenchRunner& runner, const Model& model)
+    {
+        constexpr int kFaces = 64;
+        constexpr int kFragmentsPerFace = 64;
+
+        const Camera camera = default_camera();
+        const Light light(Vec3f(0.0f, 0.0f, -1.0f), {1, 1, 1}, 1.5);
+        const Texture texture(kDiffuseTexturePath);
+
+        std::array<Vec3f, kFragmentsPerFace> barycentrics{};
+        std::mt19937 rng(99);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (Vec3f& bary : barycentrics)
+        {
+            const float u = unit(rng);
+            const float v = unit(rng) * (1.0f - u);
+            bary = Vec3f(u, v, 1.0f - u - v);
+        }
+
+        for (const ShadingPrecision precision : {ShadingPrecision::Exact, ShadingPrecision::Fast})
+        {
+            PhongShader shader(model, camera, light, &texture, 0.1f, 0.5f, 32.0f, precision);
+            const int face_count = static_cast<int>(model.nfaces());
+            const int face_stride = std::max(1, face_count / kFaces);
+            auto shade = [&]
+            {
+                Vec3f sum;
+                for (int face = 0; face < kFaces; ++face)
+                {
+                    const int face_index = face * face_stride % face_count;
+                    for (int vertex_index = 0; vertex_index < 3; ++vertex_index)
+                    {
+                        shader.vertex(face_index, vertex_index);
+                    }
+                    for (int i = 0; i < kFragmentsPerFace; ++i)
+                    {
+                        Vec3f color;
+                        shader.fragment(barycentrics[i], Vec2i(i, face), color);
+                        sum += color;
+                    }
+                }
+                sink = sink + sum.x;
+            };
+            runner.run(precision == ShadingPrecision::Exact ? "shade/phong exact" : "shade/phong fast",
+                       kFaces * kFragmentsPerFace, 1e6, "Mfrag/s", shade);
+        }
+    }
+
+    void projection_benchmarks(BenchRunner& runner, const Model& model)
+    {
+        const Camera camera = default_camera();
+        const int vertex_count = static_cast<int>(model.nverts());
+        runner.run("camera/project", vertex_count, 1e6, "Mvert/s", [&]
+        {
+            Vec3f sum;
+            for (int i = 0; i < vertex_count; ++i)
+            {
+                sum += camera.project(model.vert(i));
+            }
+            sink = sink + sum.x;
+        });
+        runner.run("camera/project_homogeneous", vertex_count, 1e6, "Mvert/s", [&]
+        {
+            float sum = 0.0f;
+            for (int i = 0; i < vertex_count; ++i)
+            {
+                sum += camera.project_homogeneous(model.vert(i)).w;
+            }
+            sink = sink + sum;
+        });
+    }
+
+    void loader_benchmarks(BenchRunner& runner)
+    {
+        for (const String& path : kLoadPaths)
+        {
+            const double bytes = static_cast<double>(std::filesystem::file_size(path));
+            runner.run("model/load " + std::filesystem::path(path).filename().string(), bytes, 1e6, "MB/s", [&]
+            {
+                // Model prints its vertex and face counts on every load.
+                std::ostringstream discard;
+                std::streambuf* const previous = std::cout.rdbuf(discard.rdbuf());
+                const Model model(path);
+                std::cout.rdbuf(previous);
+                sink = sink + static_cast<float>(model.nfaces());
+            });
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const BenchSettings settings = parse_settings(argc, argv);
+
+    std::ostringstream discard;
+    std::streambuf* const previous = std::cout.rdbuf(discard.rdbuf());
+    const Model model(kModelPath);
+    std::cout.rdbuf(previous);
+
+    BenchRunner runner(settings);
+    raster_benchmarks(runner);
+    texture_benchmarks(runner);
+    shading_benchmarks(runner, model);
+    projection_benchmarks(runner, model);
+    loader_benchmarks(runner);
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include "block_compression.h"
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+    uint16_t pack_565(int r, int g, int b)
+    {
+        return static_cast<uint16_t>(((r * 31 + 127) / 255) << 11 |
+                                     ((g * 63 + 127) / 255) << 5 |
+                                     ((b * 31 + 127) / 255));
+    }
+
+    std::array<int, 3> unpack_565(uint16_t c)
+    {
+        const int r = (c >> 11) & 31;
+        const int g = (c >> 5) & 63;
+        const int b = c & 31;
+        return {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)};
+    }
+
+    void build_palette(uint16_t c0, uint16_t c1, std::array<std::array<int, 3>, 4>& palette)
+    {
+        palette[0] = unpack_565(c0);
+        palette[1] = unpack_565(c1);
+        for (int c = 0; c < 3; ++c)
+        {
+            if (c0 > c1)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            else
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+    }
+}
+
+namespace bc1
+{
+    void encode_block(const unsigned char* rgb, unsigned char* block)
+    {
+        std::array<int, 3> lo{255, 255, 255};
+        std::array<int, 3> hi{0, 0, 0};
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                lo[c] = std::min<int>(lo[c], rgb[i * 3 + c]);
+                hi[c] = std::max<int>(hi[c], rgb[i * 3 + c]);
+            }
+        }
+
+        // Pull the bounding box corners in slightly so the palette covers the
+        // bulk of the block rather than its outliers.
+        for (int c = 0; c < 3; ++c)
+        {
+            const int inset = (hi[c] - lo[c]) / 16;
+            lo[c] += inset;
+            hi[c] -= inset;
+        }
+
+        uint16_t c0 = pack_565(hi[0], hi[1], hi[2]);
+        uint16_t c1 = pack_565(lo[0], lo[1], lo[2]);
+        if (c0 < c1)
+        {
+            std::swap(c0, c1);
+        }
+
+        uint32_t indices = 0;
+        if (c0 != c1)
+        {
+            std::array<std::array<int, 3>, 4> palette{};
+            build_palette(c0, c1, palette);
+            for (int i = 0; i < 16; ++i)
+            {
+                int best = 0;
+                int best_error = 1 << 30;
+                for (int p = 0; p < 4; ++p)
+                {
+                    const int dr = rgb[i * 3] - palette[p][0];
+                    const int dg = rgb[i * 3 + 1] - palette[p][1];
+                    const int db = rgb[i * 3 + 2] - palette[p][2];
+                    const int error = dr * dr + dg * dg + db * db;
+                    if (error < best_error)
+                    {
+                        best_error = error;
+                        best = p;
+                    }
+                }
+                indices |= static_cast<uint32_t>(best) << (i * 2);
+            }
+        }
+
+        block[0] = static_cast<unsigned char>(c0 & 0xff);
+        block[1] = static_cast<unsigned char>(c0 >> 8);
+        block[2] = static_cast<unsigned char>(c1 & 0xff);
+        block[3] = static_cast<unsigned char>(c1 >> 8);
+        for (int i = 0; i < 4; ++i)
+        {
+            block[4 + i] = static_cast<unsigned char>((indices >> (i * 8)) & 0xff);
+        }
+    }
+
+    void decode_block(const unsigned char* block, unsigned char* rgb)
+    {
+        const auto c0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+        const auto c1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+        const uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+
+        std::array<std::array<int, 3>, 4> palette{};
+        build_palette(c0, c1, palette);
+        for (int i = 0; i < 16; ++i)
+        {
+            const auto& color = palette[(indices >> (i * 2)) & 3];
+            rgb[i * 3] = static_cast<unsigned char>(color[0]);
+            rgb[i * 3 + 1] = static_cast<unsigned char>(color[1]);
+            rgb[i * 3 + 2] = static_cast<unsigned char>(color[2]);
+        }
+    }
+
+    void encode_image(const unsigned char* rgb, int width, int height, unsigned char* blocks)
+    {
+        const int blocks_x = blocks_across(width);
+        const int blocks_y = blocks_across(height);
+        unsigned char texels[16 * 3];
+
+        for (int by = 0; by < blocks_y; ++by)
+        {
+            for (int bx = 0; bx < blocks_x; ++bx)
+            {
+                for (int ty = 0; ty < kBlockSize; ++ty)
+                {
+                    const int y = std::min(by * kBlockSize + ty, height - 1);
+                    for (int tx = 0; tx < kBlockSize; ++tx)
+                    {
+                        const int x = std::min(bx * kBlockSize + tx, width - 1);
+                        const unsigned char* src = rgb + (x + y * width) * 3;
+                        unsigned char* dst = texels + (tx + ty * kBlockSize) * 3;
+                        dst[0] = src[0];
+                        dst[1] = src[1];
+                        dst[2] = src[2];
+                    }
+                }
+                encode_block(texels, blocks + (bx + by * blocks_x) * kBlockBytes);
+            }
+        }
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// BC1 (DXT1) colour blocks: 4x4 RGB texels in 8 bytes, two RGB565 endpoints
+// followed by sixteen 2-bit palette indices, texel 0 in the lowest bits.
+namespace bc1
+{
+    constexpr int kBlockSize = 4;
+    constexpr size_t kBlockBytes = 8;
+
+    constexpr int blocks_across(int texels) { return (texels + kBlockSize - 1) / kBlockSize; }
+
+    constexpr size_t level_bytes(int width, int height)
+    {
+        return static_cast<size_t>(blocks_across(width)) * blocks_across(height) * kBlockBytes;
+    }
+
+    // `rgb` holds 16 texels in row order, three bytes each.
+    void encode_block(const unsigned char* rgb, unsigned char* block);
+    void decode_block(const unsigned char* block, unsigned char* rgb);
+
+    void encode_image(const unsigned char* rgb, int width, int height, unsigned char* blocks);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// Fixed-capacity multi-producer/multi-consumer FIFO. push() blocks while the
+// queue is full, pop() blocks while it is empty and returns nullopt once the
+// queue has been closed and drained. Storage is allocated once up front.
+template <class T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity)
+        : slots_(capacity == 0 ? 1 : capacity)
+    {
+    }
+
+    bool push(T value)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return closed_ || size_ < slots_.size(); });
+        if (closed_)
+        {
+            return false;
+        }
+
+        slots_[(head_ + size_) % slots_.size()] = std::move(value);
+        ++size_;
+        lock.unlock();
+        not_empty_.notify_one();
+        return true;
+    }
+
+    std::optional<T> pop()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return closed_ || size_ > 0; });
+        if (size_ == 0)
+        {
+            return std::nullopt;
+        }
+
+        std::optional<T> value = std::move(slots_[head_]);
+        slots_[head_].reset();
+        head_ = (head_ + 1) % slots_.size();
+        --size_;
+        lock.unlock();
+        not_full_.notify_one();
+        return value;
+    }
+
+    void close()
+    {
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+    [[nodiscard]] size_t capacity() const { return slots_.size(); }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::vector<std::optional<T>> slots_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+    bool closed_ = false;
+};
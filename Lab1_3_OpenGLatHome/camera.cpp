@@ -26,35 +26,52 @@ Camera::Camera(const Vec3f& position,
       near_plane_(near_plane),
       far_plane_(far_plane),
       screen_width_(screen_width),
-      screen_height_(screen_height)
+      screen_height_(screen_height),
+      z_axis_((position - target).normalized()),
+      focal_(1.0f / std::tan(fov_deg * std::numbers::pi_v<float> / 180.0f / 2.0f))
 {
+    x_axis_ = up_dir.cross(z_axis_).normalized();
+    y_axis_ = z_axis_.cross(x_axis_);
 }
 
 Vec3f Camera::project(const Vec3f& vertex) const
 {
-    const Vec3f z = (position_ - target_).normalized();
-    const Vec3f x = up_.cross(z).normalized();
-    const Vec3f y = z.cross(x);
+    return project_homogeneous(vertex).xyz();
+}
 
+Vec4f Camera::project_homogeneous(const Vec3f& vertex) const
+{
     const Vec3f translated = vertex - position_;
-    const float vx = translated.dot(x);
-    const float vy = translated.dot(y);
-    float vz = translated.dot(z);
+    const float vx = translated.dot(x_axis_);
+    const float vy = translated.dot(y_axis_);
+    float vz = translated.dot(z_axis_);
 
     if (std::abs(vz) < kEpsilon)
     {
         vz = (vz >= 0.0f) ? kEpsilon : -kEpsilon;
     }
 
-    const float fov_rad = fov_deg_ * std::numbers::pi_v<float> / 180.0f;
-    const float f = 1.0f / std::tan(fov_rad / 2.0f);
-    const float px = (vx / -vz) * f * aspect_;
-    const float py = (vy / -vz) * f;
+    const float px = (vx / -vz) * focal_ * aspect_;
+    const float py = (vy / -vz) * focal_;
     const float normalized_depth = std::clamp((-(vz) - near_plane_) / (far_plane_ - near_plane_), 0.0f, 1.0f);
 
     const float sx = (px + 1.0f) * 0.5f * static_cast<float>(screen_width_);
     const float sy = (py + 1.0f) * 0.5f * static_cast<float>(screen_height_);
     const float sz = 1.0f - normalized_depth;
 
-    return {sx, sy, sz};
+    return {sx, sy, sz, 1.0f / -vz};
+}
+
+float Camera::view_depth(const Vec3f& point) const
+{
+    return -(point - position_).dot(z_axis_);
+}
+
+Vec3f Camera::unproject(float screen_x, float screen_y, float view_depth) const
+{
+    const float px = screen_x / (0.5f * static_cast<float>(screen_width_)) - 1.0f;
+    const float py = screen_y / (0.5f * static_cast<float>(screen_height_)) - 1.0f;
+    const float vx = px * view_depth / (focal_ * aspect_);
+    const float vy = py * view_depth / focal_;
+    return position_ + x_axis_ * vx + y_axis_ * vy - z_axis_ * view_depth;
 }
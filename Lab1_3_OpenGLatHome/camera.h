@@ -16,6 +16,13 @@ public:
            int screen_height);
 
     Vec3f project(const Vec3f& vertex) const;
+    // Screen x/y, depth as in project(), and 1/w (reciprocal view depth) for
+    // perspective-correct interpolation.
+    Vec4f project_homogeneous(const Vec3f& vertex) const;
+    // Distance of `point` along the view axis (1/w of project_homogeneous()).
+    [[nodiscard]] float view_depth(const Vec3f& point) const;
+    // World position at screen x/y and the given view depth.
+    [[nodiscard]] Vec3f unproject(float screen_x, float screen_y, float view_depth) const;
 
     [[nodiscard]] Vec3f get_position() const { return position_; }
     [[nodiscard]] Vec3f get_target() const { return target_; }
@@ -39,4 +46,10 @@ private:
 
     int screen_width_;
     int screen_height_;
+
+    // View basis (z points away from the target) and focal length.
+    Vec3f x_axis_;
+    Vec3f y_axis_;
+    Vec3f z_axis_;
+    float focal_;
 };
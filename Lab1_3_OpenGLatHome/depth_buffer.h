@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+enum class DepthFormat
+{
+    Float32,
+    // 24 significant bits in a 32-bit word (D24X8).
+    Unorm24,
+    Unorm16
+};
+
+// Depth buffer stored in 8x8 tiles, so the depth tests of a triangle touch a
+// few compact blocks instead of one cache line per scanline. Every tile has a
+// "cleared" flag: clear() only sets the flags, and a tile's values are filled
+// in the first time a pixel in it is written. Larger values are nearer.
+template <DepthFormat Format>
+class DepthBuffer
+{
+public:
+    using Value = std::conditional_t<Format == DepthFormat::Float32, float,
+                                     std::conditional_t<Format == DepthFormat::Unorm24, uint32_t, uint16_t>>;
+
+    static constexpr DepthFormat kFormat = Format;
+    static constexpr int kTileSize = 8;
+    static constexpr int kTileArea = kTileSize * kTileSize;
+
+    // Unorm formats reserve 0 for "never written", so a surface exactly on the
+    // far plane still passes against a cleared pixel.
+    static constexpr Value kClearValue = Format == DepthFormat::Float32 ? std::numeric_limits<float>::lowest() : 0;
+
+    DepthBuffer(int width, int height)
+        : width_(width),
+          height_(height),
+          tiles_x_((width + kTileSize - 1) / kTileSize),
+          tiles_y_((height + kTileSize - 1) / kTileSize),
+          values_(static_cast<size_t>(tiles_x_) * tiles_y_ * kTileArea, kClearValue),
+          cleared_(static_cast<size_t>(tiles_x_) * tiles_y_, 1)
+    {
+    }
+
+    // `z` in [0, 1] as produced by Camera::project_homogeneous().
+    static Value encode(float z)
+    {
+        if constexpr (Format == DepthFormat::Float32)
+        {
+            return z;
+        }
+        else
+        {
+            return static_cast<Value>(1u + static_cast<uint32_t>(std::clamp(z, 0.0f, 1.0f) * kLevels + 0.5f));
+        }
+    }
+
+    static float decode(Value value)
+    {
+        if constexpr (Format == DepthFormat::Float32)
+        {
+            return value;
+        }
+        else
+        {
+            return value == 0 ? std::numeric_limits<float>::lowest()
+                              : static_cast<float>(value - 1u) / kLevels;
+        }
+    }
+
+    [[nodiscard]] int width() const { return width_; }
+    [[nodiscard]] int height() const { return height_; }
+
+    void clear()
+    {
+        std::fill(cleared_.begin(), cleared_.end(), uint8_t{1});
+    }
+
+    [[nodiscard]] bool passes(int x, int y, Value value) const
+    {
+        const size_t tile = tile_index(x, y);
+        return cleared_[tile] || value > values_[tile * kTileArea + offset_in_tile(x, y)];
+    }
+
+    // Exact match against a written pixel; the test for a pass that follows
+    // a depth pre-pass over the same geometry.
+    [[nodiscard]] bool equals(int x, int y, Value value) const
+    {
+        const size_t tile = tile_index(x, y);
+        return !cleared_[tile] && value == values_[tile * kTileArea + offset_in_tile(x, y)];
+    }
+
+    void store(int x, int y, Value value)
+    {
+        const size_t tile = tile_index(x, y);
+        Value* values = values_.data() + tile * kTileArea;
+        if (cleared_[tile])
+        {
+            std::fill_n(values, kTileArea, kClearValue);
+            cleared_[tile] = 0;
+        }
+        values[offset_in_tile(x, y)] = value;
+    }
+
+    // Row-major depth in the Float32 convention; never-written pixels read as
+    // lowest(). `out` keeps its capacity between frames.
+    void resolve(std::vector<float>& out) const
+    {
+        out.resize(static_cast<size_t>(width_) * height_);
+        for (int tile_y = 0; tile_y < tiles_y_; ++tile_y)
+        {
+            for (int tile_x = 0; tile_x < tiles_x_; ++tile_x)
+            {
+                const size_t tile = static_cast<size_t>(tile_y) * tiles_x_ + tile_x;
+                const Value* values = values_.data() + tile * kTileArea;
+                const int x0 = tile_x * kTileSize;
+                const int x1 = std::min(x0 + kTileSize, width_);
+                for (int y = tile_y * kTileSize; y < std::min((tile_y + 1) * kTileSize, height_); ++y)
+                {
+                    float* row = out.data() + static_cast<size_t>(y) * width_;
+                    if (cleared_[tile])
+                    {
+                        std::fill(row + x0, row + x1, std::numeric_limits<float>::lowest());
+                        continue;
+                    }
+                    const Value* tile_row = values + (y % kTileSize) * kTileSize;
+                    for (int x = x0; x < x1; ++x)
+                    {
+                        row[x] = decode(tile_row[x - x0]);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    static constexpr float kLevels = Format == DepthFormat::Unorm24 ? 16777214.0f : 65534.0f;
+
+    [[nodiscard]] size_t tile_index(int x, int y) const
+    {
+        return static_cast<size_t>(y / kTileSize) * tiles_x_ + x / kTileSize;
+    }
+
+    static int offset_in_tile(int x, int y)
+    {
+        return (y % kTileSize) * kTileSize + x % kTileSize;
+    }
+
+    int width_;
+    int height_;
+    int tiles_x_;
+    int tiles_y_;
+    std::vector<Value> values_;
+    std::vector<uint8_t> cleared_;
+};
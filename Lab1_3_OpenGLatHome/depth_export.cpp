@@ -0,0 +1,187 @@
+#include "depth_export.h"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DEPTH_EXPORT_SSE2 1
+#endif
+
+namespace
+{
+    // code = 1 + (z - min) * scale, rounded; a flat range exports as `levels`.
+    // Subtracting first keeps precision when depth sits in a narrow band.
+    struct Mapping
+    {
+        float min;
+        float scale;
+        float bias;
+    };
+
+    Mapping make_mapping(const depth_export::DepthRange& range, float levels)
+    {
+        const float span = range.max - range.min;
+        if (range.empty || span <= 0.0f)
+        {
+            return {0.0f, 0.0f, levels + 0.5f};
+        }
+        return {range.min, (levels - 1.0f) / span, 1.5f};
+    }
+
+    uint32_t map_depth(float z, float clear_value, const Mapping& mapping)
+    {
+        if (z == clear_value)
+        {
+            return 0;
+        }
+        return static_cast<uint32_t>((z - mapping.min) * mapping.scale + mapping.bias);
+    }
+
+#ifdef DEPTH_EXPORT_SSE2
+    // Four depth values to integer codes, zero where the pixel was never written.
+    __m128i map_depth4(const float* depth, __m128 clear, __m128 min, __m128 scale, __m128 bias)
+    {
+        const __m128 z = _mm_loadu_ps(depth);
+        const __m128i written = _mm_castps_si128(_mm_cmpneq_ps(z, clear));
+        const __m128i code = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(z, min), scale), bias));
+        return _mm_and_si128(code, written);
+    }
+#endif
+}
+
+namespace depth_export
+{
+    DepthRange written_range(const float* depth, size_t count, float clear_value)
+    {
+        float min_depth = std::numeric_limits<float>::infinity();
+        float max_depth = -std::numeric_limits<float>::infinity();
+        size_t i = 0;
+#ifdef DEPTH_EXPORT_SSE2
+        const __m128 clear = _mm_set1_ps(clear_value);
+        const __m128 positive_inf = _mm_set1_ps(min_depth);
+        const __m128 negative_inf = _mm_set1_ps(max_depth);
+        __m128 vmin = positive_inf;
+        __m128 vmax = negative_inf;
+        for (; i + 4 <= count; i += 4)
+        {
+            const __m128 z = _mm_loadu_ps(depth + i);
+            const __m128 written = _mm_cmpneq_ps(z, clear);
+            vmin = _mm_min_ps(vmin, _mm_or_ps(_mm_and_ps(written, z), _mm_andnot_ps(written, positive_inf)));
+            vmax = _mm_max_ps(vmax, _mm_or_ps(_mm_and_ps(written, z), _mm_andnot_ps(written, negative_inf)));
+        }
+        alignas(16) float lanes_min[4];
+        alignas(16) float lanes_max[4];
+        _mm_store_ps(lanes_min, vmin);
+        _mm_store_ps(lanes_max, vmax);
+        min_depth = *std::min_element(lanes_min, lanes_min + 4);
+        max_depth = *std::max_element(lanes_max, lanes_max + 4);
+#endif
+        for (; i < count; ++i)
+        {
+            if (depth[i] != clear_value)
+            {
+                min_depth = std::min(min_depth, depth[i]);
+                max_depth = std::max(max_depth, depth[i]);
+            }
+        }
+
+        if (min_depth > max_depth)
+        {
+            return {};
+        }
+        return {min_depth, max_depth, false};
+    }
+
+    void to_gray8(const float* depth, size_t count, float clear_value, const DepthRange& range, unsigned char* out)
+    {
+        const Mapping mapping = make_mapping(range, 255.0f);
+        size_t i = 0;
+#ifdef DEPTH_EXPORT_SSE2
+        const __m128 clear = _mm_set1_ps(clear_value);
+        const __m128 min = _mm_set1_ps(mapping.min);
+        const __m128 scale = _mm_set1_ps(mapping.scale);
+        const __m128 bias = _mm_set1_ps(mapping.bias);
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m128i low = _mm_packs_epi32(map_depth4(depth + i, clear, min, scale, bias),
+                                                map_depth4(depth + i + 4, clear, min, scale, bias));
+            const __m128i high = _mm_packs_epi32(map_depth4(depth + i + 8, clear, min, scale, bias),
+                                                 map_depth4(depth + i + 12, clear, min, scale, bias));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(low, high));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            out[i] = static_cast<unsigned char>(map_depth(depth[i], clear_value, mapping));
+        }
+    }
+
+    void to_gray16(const float* depth, size_t count, float clear_value, const DepthRange& range, uint16_t* out)
+    {
+        const Mapping mapping = make_mapping(range, 65535.0f);
+        size_t i = 0;
+#ifdef DEPTH_EXPORT_SSE2
+        const __m128 clear = _mm_set1_ps(clear_value);
+        const __m128 min = _mm_set1_ps(mapping.min);
+        const __m128 scale = _mm_set1_ps(mapping.scale);
+        const __m128 bias = _mm_set1_ps(mapping.bias);
+        // SSE2 has no unsigned 32->16 pack: shift into signed range, pack, shift back.
+        const __m128i offset = _mm_set1_epi32(32768);
+        const __m128i flip = _mm_set1_epi16(static_cast<short>(0x8000));
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m128i low = _mm_sub_epi32(map_depth4(depth + i, clear, min, scale, bias), offset);
+            const __m128i high = _mm_sub_epi32(map_depth4(depth + i + 4, clear, min, scale, bias), offset);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(_mm_packs_epi32(low, high), flip));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            out[i] = static_cast<uint16_t>(map_depth(depth[i], clear_value, mapping));
+        }
+    }
+
+    void to_image(const float* depth, int width, int height, float clear_value, TGAImage& out)
+    {
+        if (out.get_width() != width || out.get_height() != height || out.get_bytespp() != TGAImage::GRAYSCALE)
+        {
+            out = TGAImage(width, height, TGAImage::GRAYSCALE);
+        }
+        const size_t count = static_cast<size_t>(width) * height;
+        to_gray8(depth, count, clear_value, written_range(depth, count, clear_value), out.buffer());
+    }
+
+    void write_pgm16(const float* depth, int width, int height, float clear_value, const String& path, bool flip_rows)
+    {
+        const size_t count = static_cast<size_t>(width) * height;
+        std::vector<uint16_t> values(count);
+        to_gray16(depth, count, clear_value, written_range(depth, count, clear_value), values.data());
+
+        const std::string header = "P5\n" + std::to_string(width) + " " + std::to_string(height) + "\n65535\n";
+        std::vector<unsigned char> file(header.begin(), header.end());
+        file.resize(header.size() + count * 2);
+        unsigned char* dst = file.data() + header.size();
+        for (int y = 0; y < height; ++y)
+        {
+            const uint16_t* row = values.data() + static_cast<size_t>(flip_rows ? height - 1 - y : y) * width;
+            for (int x = 0; x < width; ++x, dst += 2)
+            {
+                // PGM samples are big-endian.
+                dst[0] = static_cast<unsigned char>(row[x] >> 8);
+                dst[1] = static_cast<unsigned char>(row[x]);
+            }
+        }
+
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+        if (!out)
+        {
+            throw std::runtime_error("Failed to write depth image: " + path);
+        }
+    }
+}
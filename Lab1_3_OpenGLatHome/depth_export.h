@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "geometry.h"
+#include "libs/tgaimage.h"
+
+// Depth buffer visualisation. Depth is normalised over the range actually
+// written this frame, so the surface uses the full output precision no
+// matter where the near/far planes are. Pixels still holding the clear value
+// export as 0; written ones map onto [1, max], nearest brightest.
+namespace depth_export
+{
+    struct DepthRange
+    {
+        float min = 0.0f;
+        float max = 0.0f;
+        bool empty = true;
+    };
+
+    DepthRange written_range(const float* depth, size_t count, float clear_value);
+
+    void to_gray8(const float* depth, size_t count, float clear_value, const DepthRange& range, unsigned char* out);
+    void to_gray16(const float* depth, size_t count, float clear_value, const DepthRange& range, uint16_t* out);
+
+    // `out` is reused when it already is a width x height greyscale image.
+    void to_image(const float* depth, int width, int height, float clear_value, TGAImage& out);
+
+    // Binary 16-bit PGM, bottom row first when `flip_rows` is set. Throws
+    // std::runtime_error on failure.
+    void write_pgm16(const float* depth, int width, int height, float clear_value, const String& path, bool flip_rows);
+}
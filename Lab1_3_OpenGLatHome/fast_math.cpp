@@ -0,0 +1,46 @@
+#include "fast_math.h"
+
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace fast_math
+{
+    namespace
+    {
+        constexpr int kErrorSamplesPerEntry = 8;
+    }
+
+    const SpecularTable& SpecularTable::get(float shininess)
+    {
+        static std::mutex mutex;
+        static std::map<float, std::unique_ptr<SpecularTable>> tables;
+
+        const std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<SpecularTable>& table = tables[shininess];
+        if (!table)
+        {
+            table.reset(new SpecularTable(shininess));
+        }
+        return *table;
+    }
+
+    SpecularTable::SpecularTable(float shininess)
+        : shininess_(shininess),
+          max_error_(0.0f),
+          values_{}
+    {
+        for (int i = 0; i <= kEntries; ++i)
+        {
+            values_[i] = std::pow(static_cast<float>(i) / kEntries, shininess_);
+        }
+
+        constexpr int samples = kEntries * kErrorSamplesPerEntry;
+        for (int i = 0; i <= samples; ++i)
+        {
+            const float x = static_cast<float>(i) / samples;
+            max_error_ = std::max(max_error_, std::abs((*this)(x) - std::pow(x, shininess_)));
+        }
+    }
+}
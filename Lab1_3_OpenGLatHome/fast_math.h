@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "geometry.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FAST_MATH_SSE2 1
+#endif
+
+namespace fast_math
+{
+    constexpr std::array<float, 256> make_byte_to_float()
+    {
+        std::array<float, 256> table{};
+        for (int i = 0; i < 256; ++i)
+        {
+            table[i] = static_cast<float>(i) / 255.0f;
+        }
+        return table;
+    }
+
+    // Same values as `byte / 255.0f`, without the divide.
+    inline constexpr std::array<float, 256> kByteToFloat = make_byte_to_float();
+
+    // Clamps to [0, 1], scales to [0, 255] and truncates, exactly like the
+    // scalar static_cast<unsigned char>(std::clamp(c, 0, 1) * 255) sequence.
+    // Bytes are R, G, B, A in memory order; alpha is opaque.
+    inline uint32_t pack_rgba8(const Vec3f& color)
+    {
+#ifdef FAST_MATH_SSE2
+        __m128 value = _mm_set_ps(0.0f, color.z, color.y, color.x);
+        value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        const __m128i bytes = _mm_cvttps_epi32(_mm_mul_ps(value, _mm_set1_ps(255.0f)));
+        const __m128i words = _mm_packs_epi32(bytes, bytes);
+        const auto rgb = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(words, words)));
+        return rgb | 0xff000000u;
+#else
+        const auto r = static_cast<uint32_t>(std::clamp(color.x, 0.0f, 1.0f) * 255.0f);
+        const auto g = static_cast<uint32_t>(std::clamp(color.y, 0.0f, 1.0f) * 255.0f);
+        const auto b = static_cast<uint32_t>(std::clamp(color.z, 0.0f, 1.0f) * 255.0f);
+        return r | (g << 8) | (b << 16) | 0xff000000u;
+#endif
+    }
+
+    // 10 bits per colour channel from bit 0 (R) upwards, 2-bit opaque alpha on top.
+    inline uint32_t pack_rgb10a2(const Vec3f& color)
+    {
+        const auto r = static_cast<uint32_t>(std::clamp(color.x, 0.0f, 1.0f) * 1023.0f);
+        const auto g = static_cast<uint32_t>(std::clamp(color.y, 0.0f, 1.0f) * 1023.0f);
+        const auto b = static_cast<uint32_t>(std::clamp(color.z, 0.0f, 1.0f) * 1023.0f);
+        return r | (g << 10) | (b << 20) | 0xc0000000u;
+    }
+
+    // Piecewise-linear pow(x, shininess) over x in [0, 1]. Tables are built
+    // once per distinct shininess and shared for the lifetime of the process.
+    class SpecularTable
+    {
+    public:
+        static constexpr int kEntries = 1024;
+
+        static const SpecularTable& get(float shininess);
+
+        [[nodiscard]] float shininess() const { return shininess_; }
+        // Largest |table - std::pow| found by dense sampling when the table was built.
+        [[nodiscard]] float max_error() const { return max_error_; }
+
+        [[nodiscard]] float operator()(float x) const
+        {
+            const float position = std::clamp(x, 0.0f, 1.0f) * static_cast<float>(kEntries);
+            const int index = std::min(static_cast<int>(position), kEntries - 1);
+            const float t = position - static_cast<float>(index);
+            return values_[index] + (values_[index + 1] - values_[index]) * t;
+        }
+
+    private:
+        explicit SpecularTable(float shininess);
+
+        float shininess_;
+        float max_error_;
+        std::array<float, kEntries + 1> values_;
+    };
+}
@@ -0,0 +1,110 @@
+#include "frame_arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    // Enough for a PNG encode of an 800x800 RGBA frame, including the zlib
+    // hash chains; larger images spill to the heap.
+    constexpr size_t kThreadScratchBytes = 32u << 20;
+}
+
+FrameArena::FrameArena(size_t capacity)
+    : storage_(new unsigned char[capacity]),
+      capacity_(capacity)
+{
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment)
+{
+    const size_t start = (offset_ + alignment - 1) / alignment * alignment;
+    if (start + bytes > capacity_ || start + bytes < start)
+    {
+        return nullptr;
+    }
+
+    last_offset_ = start;
+    offset_ = start + bytes;
+    high_water_ = std::max(high_water_, offset_);
+    return storage_.get() + start;
+}
+
+void* FrameArena::reallocate(void* ptr, size_t old_bytes, size_t new_bytes)
+{
+    if (!ptr)
+    {
+        return allocate(new_bytes);
+    }
+
+    const auto start = static_cast<size_t>(static_cast<unsigned char*>(ptr) - storage_.get());
+    if (start == last_offset_ && start + new_bytes <= capacity_)
+    {
+        offset_ = start + new_bytes;
+        high_water_ = std::max(high_water_, offset_);
+        return ptr;
+    }
+
+    void* moved = allocate(new_bytes);
+    if (moved)
+    {
+        std::memcpy(moved, ptr, std::min(old_bytes, new_bytes));
+    }
+    return moved;
+}
+
+bool FrameArena::owns(const void* ptr) const
+{
+    const auto* bytes = static_cast<const unsigned char*>(ptr);
+    return bytes >= storage_.get() && bytes < storage_.get() + capacity_;
+}
+
+void FrameArena::reset()
+{
+    offset_ = 0;
+    last_offset_ = 0;
+}
+
+FrameArena& FrameArena::thread_scratch()
+{
+    thread_local FrameArena arena(kThreadScratchBytes);
+    return arena;
+}
+
+namespace scratch
+{
+    void* allocate(size_t bytes)
+    {
+        void* ptr = FrameArena::thread_scratch().allocate(bytes);
+        return ptr ? ptr : std::malloc(bytes);
+    }
+
+    void* reallocate(void* ptr, size_t old_bytes, size_t new_bytes)
+    {
+        FrameArena& arena = FrameArena::thread_scratch();
+        if (ptr && !arena.owns(ptr))
+        {
+            return std::realloc(ptr, new_bytes);
+        }
+
+        void* moved = arena.reallocate(ptr, old_bytes, new_bytes);
+        if (!moved)
+        {
+            moved = std::malloc(new_bytes);
+            if (moved && ptr)
+            {
+                std::memcpy(moved, ptr, std::min(old_bytes, new_bytes));
+            }
+        }
+        return moved;
+    }
+
+    void release(void* ptr)
+    {
+        if (ptr && !FrameArena::thread_scratch().owns(ptr))
+        {
+            std::free(ptr);
+        }
+    }
+}
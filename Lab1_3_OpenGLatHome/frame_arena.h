@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+// Bump allocator for per-frame scratch memory. Allocations are released all
+// at once by reset(); the backing block is allocated once and reused.
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t capacity);
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // Returns nullptr when the arena is exhausted.
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+    // Grows `ptr` in place when it is the most recent allocation.
+    void* reallocate(void* ptr, size_t old_bytes, size_t new_bytes);
+    [[nodiscard]] bool owns(const void* ptr) const;
+    void reset();
+
+    [[nodiscard]] size_t capacity() const { return capacity_; }
+    [[nodiscard]] size_t used() const { return offset_; }
+    [[nodiscard]] size_t high_water() const { return high_water_; }
+
+    // Per-thread arena for encoder and export scratch.
+    static FrameArena& thread_scratch();
+
+private:
+    std::unique_ptr<unsigned char[]> storage_;
+    size_t capacity_;
+    size_t offset_ = 0;
+    size_t last_offset_ = 0;
+    size_t high_water_ = 0;
+};
+
+// malloc-style entry points over FrameArena::thread_scratch() that fall back to
+// the heap when the arena is full; used as the stb_image_write allocator.
+namespace scratch
+{
+    void* allocate(size_t bytes);
+    void* reallocate(void* ptr, size_t old_bytes, size_t new_bytes);
+    void release(void* ptr);
+}
@@ -0,0 +1,157 @@
+#include "frame_scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+namespace
+{
+    struct FrameGroup
+    {
+        explicit FrameGroup(unsigned threads)
+            : sync(static_cast<std::ptrdiff_t>(threads))
+        {
+        }
+
+        std::barrier<> sync;
+        int frame = -1;
+    };
+
+    class FrameRunner
+    {
+    public:
+        FrameRunner(int frame_count, const FrameCallbacks& callbacks)
+            : frame_count_(frame_count),
+              callbacks_(callbacks)
+        {
+        }
+
+        void run_band(FrameGroup& group, unsigned group_index, unsigned band, unsigned band_count)
+        {
+            while (true)
+            {
+                if (band == 0)
+                {
+                    group.frame = -1;
+                    if (!failed_.load(std::memory_order_acquire))
+                    {
+                        const int frame = next_frame_.fetch_add(1, std::memory_order_relaxed);
+                        if (frame < frame_count_)
+                        {
+                            group.frame = frame;
+                            guarded([&] { callbacks_.begin(group_index, frame); });
+                        }
+                    }
+                }
+
+                group.sync.arrive_and_wait();
+                const int frame = group.frame;
+                if (frame < 0)
+                {
+                    break;
+                }
+
+                guarded([&] { callbacks_.render(group_index, frame, band, band_count); });
+                group.sync.arrive_and_wait();
+
+                if (band == 0)
+                {
+                    guarded([&] { callbacks_.end(group_index, frame); });
+                }
+            }
+        }
+
+        void rethrow_if_failed()
+        {
+            const std::lock_guard<std::mutex> lock(error_mutex_);
+            if (error_)
+            {
+                std::rethrow_exception(error_);
+            }
+        }
+
+    private:
+        template <class F>
+        void guarded(F&& call)
+        {
+            try
+            {
+                call();
+            }
+            catch (...)
+            {
+                const std::lock_guard<std::mutex> lock(error_mutex_);
+                if (!error_)
+                {
+                    error_ = std::current_exception();
+                }
+                failed_.store(true, std::memory_order_release);
+            }
+        }
+
+        const int frame_count_;
+        const FrameCallbacks& callbacks_;
+        std::atomic<int> next_frame_{0};
+        std::atomic<bool> failed_{false};
+        std::mutex error_mutex_;
+        std::exception_ptr error_;
+    };
+}
+
+ParallelPlan plan_parallelism(int frame_count, unsigned cores)
+{
+    cores = std::max(1u, cores);
+    ParallelPlan plan;
+    plan.frame_workers = std::max(1u, std::min(cores, static_cast<unsigned>(std::max(1, frame_count))));
+    plan.tile_workers = std::max(1u, cores / plan.frame_workers);
+    return plan;
+}
+
+void run_frames(int frame_count, const ParallelPlan& plan, const FrameCallbacks& callbacks)
+{
+    const unsigned frame_workers = std::max(1u, plan.frame_workers);
+    const unsigned tile_workers = std::max(1u, plan.tile_workers);
+
+    FrameRunner runner(frame_count, callbacks);
+    std::vector<std::unique_ptr<FrameGroup>> groups;
+    groups.reserve(frame_workers);
+    for (unsigned g = 0; g < frame_workers; ++g)
+    {
+        groups.push_back(std::make_unique<FrameGroup>(tile_workers));
+    }
+
+    if (frame_workers == 1 && tile_workers == 1)
+    {
+        runner.run_band(*groups.front(), 0, 0, 1);
+        runner.rethrow_if_failed();
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(static_cast<size_t>(frame_workers) * tile_workers);
+    for (unsigned g = 0; g < frame_workers; ++g)
+    {
+        for (unsigned band = 0; band < tile_workers; ++band)
+        {
+            threads.emplace_back([&runner, &groups, g, band, tile_workers]
+            {
+                trace::set_thread_name("frame group " + std::to_string(g) + " band " + std::to_string(band));
+                runner.run_band(*groups[g], g, band, tile_workers);
+            });
+        }
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    runner.rethrow_if_failed();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <functional>
+
+// How a batch of independent frames is spread over the cores: `frame_workers`
+// frames are in flight at once and each of them is split into `tile_workers`
+// horizontal bands rendered by separate threads.
+struct ParallelPlan
+{
+    unsigned frame_workers = 1;
+    unsigned tile_workers = 1;
+};
+
+// Prefers frame-level parallelism (no duplicated vertex work, no sync inside
+// a frame) and only splits frames into bands when there are more cores than
+// frames left to render.
+ParallelPlan plan_parallelism(int frame_count, unsigned cores);
+
+struct FrameCallbacks
+{
+    // Called once per frame on the group's lead thread before any band runs.
+    std::function<void(unsigned group, int frame)> begin;
+    // Called on every band thread of the group; band is in [0, band_count).
+    std::function<void(unsigned group, int frame, unsigned band, unsigned band_count)> render;
+    // Called once per frame on the lead thread after all bands have finished.
+    std::function<void(unsigned group, int frame)> end;
+};
+
+// Renders frames [0, frame_count) with plan.frame_workers groups of
+// plan.tile_workers threads each. Threads are created once for the whole
+// batch. Rethrows the first exception raised by a callback.
+void run_frames(int frame_count, const ParallelPlan& plan, const FrameCallbacks& callbacks);
@@ -0,0 +1,70 @@
+#include "framebuffer.h"
+
+#include "trace.h"
+
+Framebuffer::Framebuffer(int width, int height)
+    : color(width, height),
+      depth(width, height),
+      image(width, height, TGAImage::RGB)
+{
+}
+
+void Framebuffer::clear()
+{
+    color.clear();
+    depth.clear();
+}
+
+const TGAImage& Framebuffer::resolve()
+{
+    const trace::Scope scope("resolve");
+    color.export_image(image);
+    return image;
+}
+
+FramebufferPool::FramebufferPool(int width, int height)
+    : width_(width),
+      height_(height)
+{
+}
+
+std::unique_ptr<Framebuffer> FramebufferPool::acquire()
+{
+    std::unique_ptr<Framebuffer> framebuffer;
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_.empty())
+        {
+            framebuffer = std::move(free_.back());
+            free_.pop_back();
+        }
+        else
+        {
+            ++allocated_;
+            free_.reserve(allocated_);
+        }
+    }
+
+    if (!framebuffer)
+    {
+        return std::make_unique<Framebuffer>(width_, height_);
+    }
+    framebuffer->clear();
+    return framebuffer;
+}
+
+void FramebufferPool::release(std::unique_ptr<Framebuffer> framebuffer)
+{
+    if (!framebuffer)
+    {
+        return;
+    }
+    const std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(std::move(framebuffer));
+}
+
+size_t FramebufferPool::allocated() const
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    return allocated_;
+}
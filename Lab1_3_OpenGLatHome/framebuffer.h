@@ -0,0 +1,66 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "depth_buffer.h"
+#include "libs/tgaimage.h"
+#include "render_target.h"
+
+#ifdef LAB_COLOR_RGB10A2
+using ColorTarget = RenderTarget<PixelFormat::RGB10A2>;
+#else
+using ColorTarget = RenderTarget<PixelFormat::RGBA8>;
+#endif
+
+#if defined(LAB_DEPTH_UNORM16)
+using DepthTarget = DepthBuffer<DepthFormat::Unorm16>;
+#elif defined(LAB_DEPTH_UNORM24)
+using DepthTarget = DepthBuffer<DepthFormat::Unorm24>;
+#else
+using DepthTarget = DepthBuffer<DepthFormat::Float32>;
+#endif
+
+// Frame bands are split on tile rows; both targets must agree on them.
+static_assert(ColorTarget::kTileSize == DepthTarget::kTileSize);
+
+struct Framebuffer
+{
+    Framebuffer(int width, int height);
+
+    // Black colour, empty depth. Only resets the per-tile clear flags.
+    void clear();
+
+    [[nodiscard]] int width() const { return color.width(); }
+    [[nodiscard]] int height() const { return color.height(); }
+
+    // Converts the colour target for export; the image is reused across frames.
+    const TGAImage& resolve();
+
+    ColorTarget color;
+    DepthTarget depth;
+    TGAImage image;
+};
+
+// Recycles framebuffers between frames so steady-state rendering does not
+// allocate. acquire() hands out a cleared buffer, creating one only when every
+// existing buffer is still in use (being rendered or encoded).
+class FramebufferPool
+{
+public:
+    FramebufferPool(int width, int height);
+
+    std::unique_ptr<Framebuffer> acquire();
+    void release(std::unique_ptr<Framebuffer> framebuffer);
+
+    [[nodiscard]] size_t allocated() const;
+
+private:
+    int width_;
+    int height_;
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Framebuffer>> free_;
+    size_t allocated_ = 0;
+};
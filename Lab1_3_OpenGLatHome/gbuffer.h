@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "geometry.h"
+#include "tiled_buffer.h"
+
+// Everything the deferred lighting pass needs for one pixel. The world
+// position is not stored: it is rebuilt from the pixel and the view depth.
+struct GBufferTexel
+{
+    Vec2f uv;
+    // Distance along the camera's view axis; 0 marks a pixel nothing covered.
+    float view_depth = 0.0f;
+    // Octahedral-encoded unit normal, 16 bits per component.
+    uint32_t normal = 0;
+    uint16_t material = 0;
+    // Per-pixel material parameters as unorm8 for shaders that sample them.
+    uint8_t metalness = 0;
+    uint8_t roughness = 0;
+};
+
+namespace gbuffer
+{
+    constexpr uint16_t kNoMaterial = 0xffff;
+
+    inline float sign_not_zero(float value)
+    {
+        return value >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    inline uint32_t encode_normal(const Vec3f& normal)
+    {
+        const float inv_l1 = 1.0f / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+        float x = normal.x * inv_l1;
+        float y = normal.y * inv_l1;
+        if (normal.z < 0.0f)
+        {
+            const float folded_x = (1.0f - std::abs(y)) * sign_not_zero(x);
+            y = (1.0f - std::abs(x)) * sign_not_zero(y);
+            x = folded_x;
+        }
+        const auto quantize = [](float value)
+        {
+            return static_cast<uint32_t>(std::clamp(value * 0.5f + 0.5f, 0.0f, 1.0f) * 65535.0f + 0.5f);
+        };
+        return quantize(x) | quantize(y) << 16;
+    }
+
+    inline Vec3f decode_normal(uint32_t encoded)
+    {
+        const float x = static_cast<float>(encoded & 0xffff) / 65535.0f * 2.0f - 1.0f;
+        const float y = static_cast<float>(encoded >> 16) / 65535.0f * 2.0f - 1.0f;
+        const float z = 1.0f - std::abs(x) - std::abs(y);
+        if (z < 0.0f)
+        {
+            return Vec3f((1.0f - std::abs(y)) * sign_not_zero(x), (1.0f - std::abs(x)) * sign_not_zero(y), z)
+                .normalized();
+        }
+        return Vec3f(x, y, z).normalized();
+    }
+
+    inline uint8_t to_unorm8(float value)
+    {
+        return static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+}
+
+// Surface attributes of the nearest fragment per pixel, written by the
+// deferred geometry pass and read once per pixel by the lighting pass.
+using GBuffer = TiledBuffer<GBufferTexel>;
@@ -168,6 +168,40 @@ inline std::ostream& operator<<(std::ostream& os, const Vec3<T>& v)
     return os << "(" << v.x << ", " << v.y << ", " << v.z << ")";
 }
 
+template <class T>
+struct Vec4
+{
+    T x{}, y{}, z{}, w{};
+
+    constexpr Vec4() = default;
+
+    constexpr Vec4(T x_, T y_, T z_, T w_) : x(x_), y(y_), z(z_), w(w_)
+    {
+    }
+
+    constexpr Vec4(const Vec3<T>& v, T w_) : x(v.x), y(v.y), z(v.z), w(w_)
+    {
+    }
+
+    constexpr Vec3<T> xyz() const { return {x, y, z}; }
+
+    constexpr Vec4 operator+(const Vec4& v) const { return {x + v.x, y + v.y, z + v.z, w + v.w}; }
+    constexpr Vec4 operator-(const Vec4& v) const { return {x - v.x, y - v.y, z - v.z, w - v.w}; }
+    constexpr Vec4 operator*(T s) const { return {x * s, y * s, z * s, w * s}; }
+    constexpr Vec4 operator/(T s) const { return {x / s, y / s, z / s, w / s}; }
+
+    constexpr T dot(const Vec4& v) const
+    {
+        return x * v.x + y * v.y + z * v.z + w * v.w;
+    }
+};
+
+template <class T>
+inline std::ostream& operator<<(std::ostream& os, const Vec4<T>& v)
+{
+    return os << "(" << v.x << ", " << v.y << ", " << v.z << ", " << v.w << ")";
+}
+
 using Vec2f = Vec2<float>;
 using Vec2d = Vec2<double>;
 using Vec2i = Vec2<int>;
@@ -176,4 +210,6 @@ using Vec3f = Vec3<float>;
 using Vec3d = Vec3<double>;
 using Vec3i = Vec3<int>;
 
+using Vec4f = Vec4<float>;
+
 using String = std::string;
@@ -0,0 +1,60 @@
+#include "image_compare.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "image_io.h"
+#include "libs/stb_image.h"
+
+namespace image_compare
+{
+    ImageDiff compare_with_file(const TGAImage& image, bool flip_rows, const String& path)
+    {
+        if (image.get_bytespp() != TGAImage::RGB)
+        {
+            throw std::runtime_error("Golden-image checks need an RGB image: " + path);
+        }
+
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        const std::unique_ptr<unsigned char, void (*)(void*)> reference(
+            stbi_load(path.c_str(), &width, &height, &channels, 3), stbi_image_free);
+        if (!reference)
+        {
+            throw std::runtime_error("Failed to read reference image: " + path);
+        }
+        if (width != image.get_width() || height != image.get_height())
+        {
+            throw std::runtime_error("Reference image size does not match: " + path);
+        }
+
+        std::vector<unsigned char> rows;
+        image_io::to_rgb_rows(image, flip_rows, rows);
+
+        ImageDiff diff;
+        double squared_error = 0.0;
+        const size_t pixel_count = static_cast<size_t>(width) * height;
+        for (size_t i = 0; i < pixel_count; ++i)
+        {
+            int pixel_max = 0;
+            for (size_t c = i * 3; c < i * 3 + 3; ++c)
+            {
+                const int delta = std::abs(static_cast<int>(rows[c]) - static_cast<int>(reference.get()[c]));
+                pixel_max = std::max(pixel_max, delta);
+                squared_error += static_cast<double>(delta) * delta;
+            }
+            diff.max_diff = std::max(diff.max_diff, pixel_max);
+            diff.differing_pixels += pixel_max != 0 ? 1 : 0;
+        }
+
+        const double mse = squared_error / static_cast<double>(pixel_count * 3);
+        diff.psnr_db = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : std::numeric_limits<double>::infinity();
+        return diff;
+    }
+}
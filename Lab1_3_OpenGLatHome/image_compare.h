@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+#include "geometry.h"
+#include "libs/tgaimage.h"
+
+// Per-channel difference between a rendered image and a reference file, for
+// golden-image checks.
+struct ImageDiff
+{
+    int max_diff = 0;
+    uint64_t differing_pixels = 0;
+    // Over all RGB channels; infinite when the images are identical.
+    double psnr_db = 0.0;
+
+    [[nodiscard]] bool identical() const { return max_diff == 0; }
+    [[nodiscard]] bool within(double min_psnr_db, int max_channel_diff) const
+    {
+        return psnr_db >= min_psnr_db && max_diff <= max_channel_diff;
+    }
+};
+
+namespace image_compare
+{
+    // Compares `image` as image_io::write_image(image, ..., flip_rows) would
+    // store it against the RGB content of the image file at `path`. Throws
+    // std::runtime_error when the file cannot be read or the sizes differ.
+    ImageDiff compare_with_file(const TGAImage& image, bool flip_rows, const String& path);
+}
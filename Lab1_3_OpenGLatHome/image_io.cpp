@@ -0,0 +1,203 @@
+#include "image_io.h"
+
+#include "frame_arena.h"
+#include "trace.h"
+
+// The PNG/JPG encoders allocate several scratch buffers per image; route them
+// to the per-thread arena so steady-state frame output stays off the heap.
+#define STBIW_MALLOC(size) scratch::allocate(size)
+#define STBIW_REALLOC_SIZED(ptr, old_size, new_size) scratch::reallocate(ptr, old_size, new_size)
+#define STBIW_FREE(ptr) scratch::release(ptr)
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "libs/stb_image_write.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    constexpr int kJpegQuality = 95;
+
+    void append_bytes(void* context, void* data, int size)
+    {
+        auto* out = static_cast<std::vector<unsigned char>*>(context);
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        out->insert(out->end(), bytes, bytes + size);
+    }
+
+    // Plain string scan: std::filesystem::path allocates its component list.
+    String lowercase_extension(const String& path)
+    {
+        const size_t dot = path.find_last_of('.');
+        const size_t slash = path.find_last_of("/\\");
+        if (dot == String::npos || (slash != String::npos && dot < slash))
+        {
+            return {};
+        }
+        String extension = path.substr(dot);
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return extension;
+    }
+}
+
+namespace image_io
+{
+    ImageFormat format_from_path(const String& path)
+    {
+        const String extension = lowercase_extension(path);
+        if (extension == ".tga")
+        {
+            return ImageFormat::TGA;
+        }
+        if (extension == ".bmp")
+        {
+            return ImageFormat::BMP;
+        }
+        if (extension == ".jpg" || extension == ".jpeg")
+        {
+            return ImageFormat::JPG;
+        }
+        return ImageFormat::PNG;
+    }
+
+    void to_rgb_rows(const TGAImage& image, bool flip_rows, std::vector<unsigned char>& out)
+    {
+        const int width = image.get_width();
+        const int height = image.get_height();
+        const int channels = image.get_bytespp();
+        const size_t row_bytes = static_cast<size_t>(width) * channels;
+        out.resize(row_bytes * height);
+
+        const unsigned char* src = image.buffer();
+        for (int y = 0; y < height; ++y)
+        {
+            const unsigned char* src_row = src + static_cast<size_t>(flip_rows ? height - 1 - y : y) * row_bytes;
+            unsigned char* dst_row = out.data() + static_cast<size_t>(y) * row_bytes;
+            if (channels < 3)
+            {
+                std::memcpy(dst_row, src_row, row_bytes);
+                continue;
+            }
+
+            for (int x = 0; x < width; ++x)
+            {
+                const unsigned char* s = src_row + x * channels;
+                unsigned char* d = dst_row + x * channels;
+                d[0] = s[2];
+                d[1] = s[1];
+                d[2] = s[0];
+                if (channels == 4)
+                {
+                    d[3] = s[3];
+                }
+            }
+        }
+    }
+
+    void write_image(const TGAImage& image, const String& path, bool flip_rows)
+    {
+        write_image(image, path, format_from_path(path), flip_rows);
+    }
+
+    void write_image(const TGAImage& image, const String& path, ImageFormat format, bool flip_rows)
+    {
+        if (!image.buffer())
+        {
+            throw std::runtime_error("Cannot write empty image: " + path);
+        }
+
+        // TGA keeps the framebuffer's BGR layout and flips through the header,
+        // so it skips the row conversion entirely.
+        if (format == ImageFormat::TGA)
+        {
+            const trace::Scope scope("write");
+            if (!image.write_tga_file(path.c_str(), true, flip_rows))
+            {
+                throw std::runtime_error("Failed to write image file: " + path);
+            }
+            return;
+        }
+
+        // PNG is encoded in memory first so that encoding and file I/O are
+        // timed apart; the bytes are the same as stbi_write_png's.
+        if (format == ImageFormat::PNG)
+        {
+            thread_local std::vector<unsigned char> encoded;
+            {
+                const trace::Scope scope("encode");
+                encode_png(image, flip_rows, encoded);
+            }
+
+            const trace::Scope scope("write");
+            std::FILE* file = std::fopen(path.c_str(), "wb");
+            if (!file)
+            {
+                throw std::runtime_error("Failed to write image file: " + path);
+            }
+            const bool written = std::fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+            if (std::fclose(file) != 0 || !written)
+            {
+                throw std::runtime_error("Failed to write image file: " + path);
+            }
+            return;
+        }
+
+        // BMP and JPG write straight from the encoder, so "encode" includes I/O.
+        const trace::Scope scope("encode");
+        // Reused between calls so steady-state frame output does not allocate.
+        thread_local std::vector<unsigned char> rows;
+        to_rgb_rows(image, flip_rows, rows);
+
+        const int width = image.get_width();
+        const int height = image.get_height();
+        const int channels = image.get_bytespp();
+
+        FrameArena::thread_scratch().reset();
+        int result = 0;
+        switch (format)
+        {
+        case ImageFormat::BMP:
+            result = stbi_write_bmp(path.c_str(), width, height, channels, rows.data());
+            break;
+        case ImageFormat::JPG:
+            result = stbi_write_jpg(path.c_str(), width, height, channels, rows.data(), kJpegQuality);
+            break;
+        case ImageFormat::PNG:
+        case ImageFormat::TGA:
+            break;
+        }
+        FrameArena::thread_scratch().reset();
+
+        if (result == 0)
+        {
+            throw std::runtime_error("Failed to write image file: " + path);
+        }
+    }
+
+    void encode_png(const TGAImage& image, bool flip_rows, std::vector<unsigned char>& out)
+    {
+        if (!image.buffer())
+        {
+            throw std::runtime_error("Cannot encode empty image");
+        }
+
+        thread_local std::vector<unsigned char> rows;
+        to_rgb_rows(image, flip_rows, rows);
+
+        const int width = image.get_width();
+        const int channels = image.get_bytespp();
+        out.clear();
+        FrameArena::thread_scratch().reset();
+        const int result = stbi_write_png_to_func(append_bytes, &out, width, image.get_height(), channels,
+                                                  rows.data(), width * channels);
+        FrameArena::thread_scratch().reset();
+        if (result == 0)
+        {
+            throw std::runtime_error("Failed to encode PNG");
+        }
+    }
+}
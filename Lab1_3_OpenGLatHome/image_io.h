@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+#include "geometry.h"
+#include "libs/tgaimage.h"
+
+namespace image_io
+{
+    enum class ImageFormat
+    {
+        PNG,
+        TGA,
+        BMP,
+        JPG
+    };
+
+    // Picks the format from the file extension; PNG when it is unknown.
+    ImageFormat format_from_path(const String& path);
+
+    // Converts TGAImage memory (BGR/BGRA/grey rows) to tightly packed RGB/RGBA/grey
+    // rows in `out`, bottom row first when `flip_rows` is set.
+    void to_rgb_rows(const TGAImage& image, bool flip_rows, std::vector<unsigned char>& out);
+
+    // Encodes straight from the framebuffer memory, without an intermediate file.
+    // Throws std::runtime_error on failure.
+    void write_image(const TGAImage& image, const String& path, bool flip_rows);
+    void write_image(const TGAImage& image, const String& path, ImageFormat format, bool flip_rows);
+
+    // Complete PNG file in memory; `out` is overwritten and keeps its capacity.
+    void encode_png(const TGAImage& image, bool flip_rows, std::vector<unsigned char>& out);
+}
@@ -0,0 +1,115 @@
+#include "image_writer.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "image_io.h"
+#include "trace.h"
+
+AsyncImageWriter::AsyncImageWriter(unsigned threads, size_t queue_depth)
+    : queue_(queue_depth != 0 ? queue_depth : std::max<size_t>(2, threads * 2))
+{
+    workers_.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i)
+    {
+        workers_.emplace_back(&AsyncImageWriter::worker, this);
+    }
+}
+
+AsyncImageWriter::~AsyncImageWriter()
+{
+    queue_.close();
+    for (std::thread& thread : workers_)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+}
+
+unsigned AsyncImageWriter::default_thread_count()
+{
+    // One core keeps rasterizing; the rest encode.
+    const unsigned cores = std::thread::hardware_concurrency();
+    return std::max(1u, cores > 1 ? cores - 1 : 1u);
+}
+
+void AsyncImageWriter::submit(TGAImage image, const String& path, bool flip_rows)
+{
+    if (workers_.empty())
+    {
+        image_io::write_image(image, path, flip_rows);
+        return;
+    }
+
+    queue_.push(Job{std::move(image), nullptr, path, flip_rows, nullptr});
+}
+
+void AsyncImageWriter::submit(const TGAImage& image, const String& path, bool flip_rows,
+                              std::function<void()> release)
+{
+    Job job{TGAImage(), &image, path, flip_rows, std::move(release)};
+    if (workers_.empty())
+    {
+        encode(job);
+        rethrow_if_failed();
+        return;
+    }
+
+    queue_.push(std::move(job));
+}
+
+void AsyncImageWriter::finish()
+{
+    if (!finished_)
+    {
+        finished_ = true;
+        queue_.close();
+        for (std::thread& thread : workers_)
+        {
+            thread.join();
+        }
+    }
+
+    rethrow_if_failed();
+}
+
+void AsyncImageWriter::rethrow_if_failed()
+{
+    const std::lock_guard<std::mutex> lock(error_mutex_);
+    if (error_)
+    {
+        std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+}
+
+void AsyncImageWriter::worker()
+{
+    trace::set_thread_name("image encoder");
+    while (std::optional<Job> job = queue_.pop())
+    {
+        encode(*job);
+    }
+}
+
+void AsyncImageWriter::encode(Job& job)
+{
+    try
+    {
+        image_io::write_image(job.image ? *job.image : job.owned, job.path, job.flip_rows);
+    }
+    catch (...)
+    {
+        const std::lock_guard<std::mutex> lock(error_mutex_);
+        if (!error_)
+        {
+            error_ = std::current_exception();
+        }
+    }
+
+    if (job.release)
+    {
+        job.release();
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "geometry.h"
+#include "libs/tgaimage.h"
+
+// Encodes finished frames on a pool of worker threads so the caller can
+// render the next frame meanwhile. At most `queue_depth` frames wait for an
+// encoder; submit() blocks beyond that, which caps memory use.
+class AsyncImageWriter
+{
+public:
+    // `threads == 0` encodes synchronously inside submit().
+    explicit AsyncImageWriter(unsigned threads, size_t queue_depth = 0);
+    ~AsyncImageWriter();
+
+    AsyncImageWriter(const AsyncImageWriter&) = delete;
+    AsyncImageWriter& operator=(const AsyncImageWriter&) = delete;
+
+    static unsigned default_thread_count();
+
+    void submit(TGAImage image, const String& path, bool flip_rows);
+    // Encodes a borrowed image; `release` runs on the encoder thread once the
+    // image is no longer needed (also when encoding fails).
+    void submit(const TGAImage& image, const String& path, bool flip_rows, std::function<void()> release);
+
+    // Waits for all queued frames; rethrows the first encoding error.
+    void finish();
+
+private:
+    struct Job
+    {
+        TGAImage owned;
+        const TGAImage* image = nullptr;
+        String path;
+        bool flip_rows = false;
+        std::function<void()> release;
+    };
+
+    void worker();
+    void encode(Job& job);
+    void rethrow_if_failed();
+
+    BoundedQueue<Job> queue_;
+    std::vector<std::thread> workers_;
+
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+    bool finished_ = false;
+};
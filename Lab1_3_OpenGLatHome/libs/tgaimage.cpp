@@ -1,11 +1,17 @@
 #include "tgaimage.h"
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <fstream>
 #include <string.h>
 #include <time.h>
 #include <math.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 TGAImage::TGAImage() : data(NULL), width(0), height(0), bytespp(0) {
 }
 
@@ -24,6 +30,11 @@ TGAImage::TGAImage(const TGAImage &img) {
 	memcpy(data, img.data, nbytes);
 }
 
+TGAImage::TGAImage(TGAImage &&img) noexcept : data(img.data), width(img.width), height(img.height), bytespp(img.bytespp) {
+	img.data = NULL;
+	img.width = img.height = img.bytespp = 0;
+}
+
 TGAImage::~TGAImage() {
 	if (data) delete [] data;
 }
@@ -41,48 +52,68 @@ TGAImage & TGAImage::operator =(const TGAImage &img) {
 	return *this;
 }
 
+TGAImage & TGAImage::operator =(TGAImage &&img) noexcept {
+	if (this != &img) {
+		if (data) delete [] data;
+		data = img.data;
+		width = img.width;
+		height = img.height;
+		bytespp = img.bytespp;
+		img.data = NULL;
+		img.width = img.height = img.bytespp = 0;
+	}
+	return *this;
+}
+
 bool TGAImage::read_tga_file(const char *filename) {
 	if (data) delete [] data;
 	data = NULL;
 	std::ifstream in;
-	in.open (filename, std::ios::binary);
+	in.open (filename, std::ios::binary | std::ios::ate);
 	if (!in.is_open()) {
 		std::cerr << "can't open file " << filename << "\n";
-		in.close();
 		return false;
 	}
-	TGA_Header header;
-	in.read((char *)&header, sizeof(header));
-	if (!in.good()) {
-		in.close();
+	// one read for the whole file; headers and RLE packets are parsed from memory
+	const std::streamoff filesize = in.tellg();
+	if (filesize < (std::streamoff)sizeof(TGA_Header)) {
 		std::cerr << "an error occured while reading the header\n";
 		return false;
 	}
+	std::unique_ptr<unsigned char[]> file(new unsigned char[filesize]);
+	in.seekg(0);
+	in.read((char *)file.get(), filesize);
+	if (!in.good()) {
+		std::cerr << "an error occured while reading the data\n";
+		return false;
+	}
+	in.close();
+
+	TGA_Header header;
+	memcpy(&header, file.get(), sizeof(header));
 	width   = header.width;
 	height  = header.height;
 	bytespp = header.bitsperpixel>>3;
 	if (width<=0 || height<=0 || (bytespp!=GRAYSCALE && bytespp!=RGB && bytespp!=RGBA)) {
-		in.close();
 		std::cerr << "bad bpp (or width/height) value\n";
 		return false;
 	}
+	const unsigned char *pixels = file.get() + sizeof(header) + (unsigned char)header.idlength;
+	const unsigned char *end = file.get() + filesize;
 	unsigned long nbytes = bytespp*width*height;
 	data = new unsigned char[nbytes];
 	if (3==header.datatypecode || 2==header.datatypecode) {
-		in.read((char *)data, nbytes);
-		if (!in.good()) {
-			in.close();
+		if (pixels > end || (unsigned long)(end - pixels) < nbytes) {
 			std::cerr << "an error occured while reading the data\n";
 			return false;
 		}
+		memcpy(data, pixels, nbytes);
 	} else if (10==header.datatypecode||11==header.datatypecode) {
-		if (!load_rle_data(in)) {
-			in.close();
+		if (pixels > end || !load_rle_data(pixels, end)) {
 			std::cerr << "an error occured while reading the data\n";
 			return false;
 		}
 	} else {
-		in.close();
 		std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
 		return false;
 	}
@@ -93,121 +124,112 @@ bool TGAImage::read_tga_file(const char *filename) {
 		flip_horizontally();
 	}
 	std::cerr << width << "x" << height << "/" << bytespp*8 << "\n";
-	in.close();
 	return true;
 }
 
-bool TGAImage::load_rle_data(std::ifstream &in) {
+bool TGAImage::load_rle_data(const unsigned char *in, const unsigned char *end) {
 	unsigned long pixelcount = width*height;
 	unsigned long currentpixel = 0;
-	unsigned long currentbyte  = 0;
-	TGAColor colorbuffer;
+	unsigned char *out = data;
 	do {
-		unsigned char chunkheader = 0;
-		chunkheader = in.get();
-		if (!in.good()) {
+		if (in >= end) {
 			std::cerr << "an error occured while reading the data\n";
 			return false;
 		}
+		unsigned char chunkheader = *in++;
 		if (chunkheader<128) {
-			chunkheader++;
-			for (int i=0; i<chunkheader; i++) {
-				in.read((char *)colorbuffer.raw, bytespp);
-				if (!in.good()) {
-					std::cerr << "an error occured while reading the header\n";
-					return false;
-				}
-				for (int t=0; t<bytespp; t++)
-					data[currentbyte++] = colorbuffer.raw[t];
-				currentpixel++;
-				if (currentpixel>pixelcount) {
-					std::cerr << "Too many pixels read\n";
-					return false;
-				}
+			unsigned long count = chunkheader+1;
+			unsigned long chunkbytes = count*bytespp;
+			if (currentpixel+count>pixelcount) {
+				std::cerr << "Too many pixels read\n";
+				return false;
 			}
+			if ((unsigned long)(end-in)<chunkbytes) {
+				std::cerr << "an error occured while reading the header\n";
+				return false;
+			}
+			memcpy(out, in, chunkbytes);
+			in += chunkbytes;
+			out += chunkbytes;
+			currentpixel += count;
 		} else {
-			chunkheader -= 127;
-			in.read((char *)colorbuffer.raw, bytespp);
-			if (!in.good()) {
+			unsigned long count = chunkheader-127;
+			if (currentpixel+count>pixelcount) {
+				std::cerr << "Too many pixels read\n";
+				return false;
+			}
+			if ((unsigned long)(end-in)<(unsigned long)bytespp) {
 				std::cerr << "an error occured while reading the header\n";
 				return false;
 			}
-			for (int i=0; i<chunkheader; i++) {
-				for (int t=0; t<bytespp; t++)
-					data[currentbyte++] = colorbuffer.raw[t];
-				currentpixel++;
-				if (currentpixel>pixelcount) {
-					std::cerr << "Too many pixels read\n";
-					return false;
+			if (1==bytespp) {
+				memset(out, *in, count);
+				out += count;
+			} else {
+				for (unsigned long i=0; i<count; i++) {
+					for (int t=0; t<bytespp; t++)
+						*out++ = in[t];
 				}
 			}
+			in += bytespp;
+			currentpixel += count;
 		}
 	} while (currentpixel < pixelcount);
 	return true;
 }
 
-bool TGAImage::write_tga_file(const char *filename, bool rle) {
-	unsigned char developer_area_ref[4] = {0, 0, 0, 0};
-	unsigned char extension_area_ref[4] = {0, 0, 0, 0};
-	unsigned char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
-	std::ofstream out;
-	out.open (filename, std::ios::binary);
-	if (!out.is_open()) {
-		std::cerr << "can't open file " << filename << "\n";
-		out.close();
-		return false;
-	}
+bool TGAImage::write_tga_file(const char *filename, bool rle, bool bottom_left) const {
+	const unsigned char developer_area_ref[4] = {0, 0, 0, 0};
+	const unsigned char extension_area_ref[4] = {0, 0, 0, 0};
+	const unsigned char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
+	const unsigned long nbytes = width*height*bytespp;
+
 	TGA_Header header;
 	memset((void *)&header, 0, sizeof(header));
 	header.bitsperpixel = bytespp<<3;
 	header.width  = width;
 	header.height = height;
 	header.datatypecode = (bytespp==GRAYSCALE?(rle?11:3):(rle?10:2));
-	header.imagedescriptor = 0x20; // top-left origin
-	out.write((char *)&header, sizeof(header));
-	if (!out.good()) {
-		out.close();
-		std::cerr << "can't dump the tga file\n";
-		return false;
-	}
+	header.imagedescriptor = bottom_left ? 0x00 : 0x20;
+
+	// the whole file is assembled in memory and handed to the OS in one write
+	std::vector<unsigned char> file;
+	file.reserve(sizeof(header) + nbytes + nbytes/128 + 1 + sizeof(developer_area_ref) + sizeof(extension_area_ref) + sizeof(footer));
+	file.insert(file.end(), (const unsigned char *)&header, (const unsigned char *)&header + sizeof(header));
 	if (!rle) {
-		out.write((char *)data, width*height*bytespp);
-		if (!out.good()) {
-			std::cerr << "can't unload raw data\n";
-			out.close();
-			return false;
-		}
+		file.insert(file.end(), data, data + nbytes);
 	} else {
-		if (!unload_rle_data(out)) {
-			out.close();
-			std::cerr << "can't unload rle data\n";
-			return false;
-		}
-	}
-	out.write((char *)developer_area_ref, sizeof(developer_area_ref));
-	if (!out.good()) {
-		std::cerr << "can't dump the tga file\n";
-		out.close();
-		return false;
+		unload_rle_data(file);
 	}
-	out.write((char *)extension_area_ref, sizeof(extension_area_ref));
-	if (!out.good()) {
-		std::cerr << "can't dump the tga file\n";
-		out.close();
+	file.insert(file.end(), developer_area_ref, developer_area_ref + sizeof(developer_area_ref));
+	file.insert(file.end(), extension_area_ref, extension_area_ref + sizeof(extension_area_ref));
+	file.insert(file.end(), footer, footer + sizeof(footer));
+
+	std::ofstream out;
+	out.open (filename, std::ios::binary);
+	if (!out.is_open()) {
+		std::cerr << "can't open file " << filename << "\n";
 		return false;
 	}
-	out.write((char *)footer, sizeof(footer));
+	out.write((const char *)file.data(), file.size());
 	if (!out.good()) {
 		std::cerr << "can't dump the tga file\n";
-		out.close();
 		return false;
 	}
 	out.close();
 	return true;
 }
 
+static inline bool pixels_equal(const unsigned char *a, const unsigned char *b, int bytespp) {
+	switch (bytespp) {
+		case 1: return *a==*b;
+		case 3: return a[0]==b[0] && a[1]==b[1] && a[2]==b[2];
+		default: return 0==memcmp(a, b, bytespp);
+	}
+}
+
 // TODO: it is not necessary to break a raw chunk for two equal pixels (for the matter of the resulting size)
-bool TGAImage::unload_rle_data(std::ofstream &out) {
+void TGAImage::unload_rle_data(std::vector<unsigned char> &out) const {
 	const unsigned char max_chunk_length = 128;
 	unsigned long npixels = width*height;
 	unsigned long curpix = 0;
@@ -217,10 +239,7 @@ bool TGAImage::unload_rle_data(std::ofstream &out) {
 		unsigned char run_length = 1;
 		bool raw = true;
 		while (curpix+run_length<npixels && run_length<max_chunk_length) {
-			bool succ_eq = true;
-			for (int t=0; succ_eq && t<bytespp; t++) {
-				succ_eq = (data[curbyte+t]==data[curbyte+t+bytespp]);
-			}
+			bool succ_eq = pixels_equal(data+curbyte, data+curbyte+bytespp, bytespp);
 			curbyte += bytespp;
 			if (1==run_length) {
 				raw = !succ_eq;
@@ -235,18 +254,9 @@ bool TGAImage::unload_rle_data(std::ofstream &out) {
 			run_length++;
 		}
 		curpix += run_length;
-		out.put(raw?run_length-1:run_length+127);
-		if (!out.good()) {
-			std::cerr << "can't dump the tga file\n";
-			return false;
-		}
-		out.write((char *)(data+chunkstart), (raw?run_length*bytespp:bytespp));
-		if (!out.good()) {
-			std::cerr << "can't dump the tga file\n";
-			return false;
-		}
+		out.push_back(raw?run_length-1:run_length+127);
+		out.insert(out.end(), data+chunkstart, data+chunkstart+(raw?run_length*bytespp:bytespp));
 	}
-	return true;
 }
 
 TGAColor TGAImage::get(int x, int y) {
@@ -264,27 +274,48 @@ bool TGAImage::set(int x, int y, TGAColor c) {
 	return true;
 }
 
-int TGAImage::get_bytespp() {
+int TGAImage::get_bytespp() const {
 	return bytespp;
 }
 
-int TGAImage::get_width() {
+int TGAImage::get_width() const {
 	return width;
 }
 
-int TGAImage::get_height() {
+int TGAImage::get_height() const {
 	return height;
 }
 
 bool TGAImage::flip_horizontally() {
 	if (!data) return false;
-	int half = width>>1;
-	for (int i=0; i<half; i++) {
-		for (int j=0; j<height; j++) {
-			TGAColor c1 = get(i, j);
-			TGAColor c2 = get(width-1-i, j);
-			set(i, j, c2);
-			set(width-1-i, j, c1);
+	unsigned long bytes_per_line = width*bytespp;
+	for (int j=0; j<height; j++) {
+		unsigned char *line = data + j*bytes_per_line;
+		if (1==bytespp) {
+			std::reverse(line, line+width);
+		} else if (4==bytespp) {
+			unsigned int *left = (unsigned int *)line;
+			unsigned int *right = left + width;
+#if defined(__SSE2__) || defined(_M_X64)
+			// four pixels from each end per step, reversed with one shuffle
+			while (right-left >= 8) {
+				right -= 4;
+				__m128i l = _mm_loadu_si128((const __m128i *)left);
+				__m128i r = _mm_loadu_si128((const __m128i *)right);
+				_mm_storeu_si128((__m128i *)left, _mm_shuffle_epi32(r, 0x1B));
+				_mm_storeu_si128((__m128i *)right, _mm_shuffle_epi32(l, 0x1B));
+				left += 4;
+			}
+#endif
+			std::reverse(left, right);
+		} else {
+			unsigned char *left = line;
+			unsigned char *right = line + bytes_per_line - 3;
+			for (; left<right; left+=3, right-=3) {
+				std::swap(left[0], right[0]);
+				std::swap(left[1], right[1]);
+				std::swap(left[2], right[2]);
+			}
 		}
 	}
 	return true;
@@ -293,16 +324,12 @@ bool TGAImage::flip_horizontally() {
 bool TGAImage::flip_vertically() {
 	if (!data) return false;
 	unsigned long bytes_per_line = width*bytespp;
-	unsigned char *line = new unsigned char[bytes_per_line];
 	int half = height>>1;
 	for (int j=0; j<half; j++) {
-		unsigned long l1 = j*bytes_per_line;
-		unsigned long l2 = (height-1-j)*bytes_per_line;
-		memmove((void *)line,      (void *)(data+l1), bytes_per_line);
-		memmove((void *)(data+l1), (void *)(data+l2), bytes_per_line);
-		memmove((void *)(data+l2), (void *)line,      bytes_per_line);
+		unsigned char *l1 = data + j*bytes_per_line;
+		unsigned char *l2 = data + (height-1-j)*bytes_per_line;
+		std::swap_ranges(l1, l1+bytes_per_line, l2);
 	}
-	delete [] line;
 	return true;
 }
 
@@ -310,6 +337,10 @@ unsigned char *TGAImage::buffer() {
 	return data;
 }
 
+const unsigned char *TGAImage::buffer() const {
+	return data;
+}
+
 void TGAImage::clear() {
 	memset((void *)data, 0, width*height*bytespp);
 }
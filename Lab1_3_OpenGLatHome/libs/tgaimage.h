@@ -1,7 +1,7 @@
 #ifndef __IMAGE_H__
 #define __IMAGE_H__
 
-#include <fstream>
+#include <vector>
 
 #pragma pack(push,1)
 struct TGA_Header {
@@ -67,8 +67,8 @@ protected:
 	int height;
 	int bytespp;
 
-	bool   load_rle_data(std::ifstream &in);
-	bool unload_rle_data(std::ofstream &out);
+	bool   load_rle_data(const unsigned char *in, const unsigned char *end);
+	void unload_rle_data(std::vector<unsigned char> &out) const;
 public:
 	enum Format {
 		GRAYSCALE=1, RGB=3, RGBA=4
@@ -77,8 +77,11 @@ public:
 	TGAImage();
 	TGAImage(int w, int h, int bpp);
 	TGAImage(const TGAImage &img);
+	TGAImage(TGAImage &&img) noexcept;
 	bool read_tga_file(const char *filename);
-	bool write_tga_file(const char *filename, bool rle=true);
+	// bottom_left stores rows in memory order but marks the file as bottom-up,
+	// which is a free vertical flip for viewers.
+	bool write_tga_file(const char *filename, bool rle=true, bool bottom_left=false) const;
 	bool flip_horizontally();
 	bool flip_vertically();
 	bool scale(int w, int h);
@@ -86,10 +89,12 @@ public:
 	bool set(int x, int y, TGAColor c);
 	~TGAImage();
 	TGAImage & operator =(const TGAImage &img);
-	int get_width();
-	int get_height();
-	int get_bytespp();
+	TGAImage & operator =(TGAImage &&img) noexcept;
+	int get_width() const;
+	int get_height() const;
+	int get_bytespp() const;
 	unsigned char *buffer();
+	const unsigned char *buffer() const;
 	void clear();
 };
 
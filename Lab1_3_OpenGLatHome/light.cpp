@@ -1,15 +1,92 @@
 #include "light.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
+
+namespace
+{
+    // Keeps the inverse-square term finite for surfaces touching the light.
+    constexpr float kMinDistanceSquared = 1e-4f;
+
+    float cos_degrees(float degrees)
+    {
+        return std::cos(degrees * std::numbers::pi_v<float> / 180.0f);
+    }
+}
+
 Light::Light(const Vec3f& direction)
     : direction_(direction.normalized()),
       color_(1.0f, 1.0f, 1.0f),
-      intensity_(1.0f)
+      intensity_(1.0f),
+      range_(std::numeric_limits<float>::infinity())
 {
 }
 
 Light::Light(const Vec3f& direction, const Vec3f& color, float intensity)
     : direction_(direction.normalized()),
       color_(color),
-      intensity_(intensity)
+      intensity_(intensity),
+      range_(std::numeric_limits<float>::infinity())
+{
+}
+
+Light Light::point(const Vec3f& position, const Vec3f& color, float intensity, float range)
+{
+    Light light(Vec3f(0.0f, 0.0f, -1.0f), color, intensity);
+    light.type_ = LightType::Point;
+    light.position_ = position;
+    light.range_ = range;
+    return light;
+}
+
+Light Light::spot(const Vec3f& position, const Vec3f& direction, const Vec3f& color, float intensity,
+                  float range, float inner_angle_deg, float outer_angle_deg)
+{
+    Light light(direction, color, intensity);
+    light.type_ = LightType::Spot;
+    light.position_ = position;
+    light.range_ = range;
+    light.cos_inner_ = cos_degrees(std::min(inner_angle_deg, outer_angle_deg));
+    light.cos_outer_ = cos_degrees(outer_angle_deg);
+    return light;
+}
+
+float Light::max_intensity() const
+{
+    return type_ == LightType::Directional ? intensity_ : intensity_ / kMinDistanceSquared;
+}
+
+LightSample Light::illuminate(const Vec3f& point) const
 {
+    if (type_ == LightType::Directional)
+    {
+        return {direction_, intensity_};
+    }
+
+    const Vec3f to_point = point - position_;
+    const float distance_squared = to_point.dot(to_point);
+    if (distance_squared >= range_ * range_)
+    {
+        return {direction_, 0.0f};
+    }
+
+    const float distance = std::sqrt(distance_squared);
+    const Vec3f direction = distance > 0.0f ? to_point / distance : direction_;
+    const float ratio_squared = distance_squared / (range_ * range_);
+    const float window = (1.0f - ratio_squared * ratio_squared);
+    float intensity = intensity_ * window * window / std::max(distance_squared, kMinDistanceSquared);
+
+    if (type_ == LightType::Spot)
+    {
+        const float cos_angle = direction.dot(direction_);
+        if (cos_angle <= cos_outer_)
+        {
+            return {direction, 0.0f};
+        }
+        const float t = std::clamp((cos_angle - cos_outer_) / std::max(cos_inner_ - cos_outer_, 1e-4f), 0.0f, 1.0f);
+        intensity *= t * t * (3.0f - 2.0f * t);
+    }
+    return {direction, intensity};
 }
@@ -2,18 +2,55 @@
 
 #include "geometry.h"
 
+enum class LightType
+{
+    Directional,
+    Point,
+    Spot
+};
+
+// What a light contributes at a surface point: the direction its light
+// travels there (same convention as Light::get_direction()) and the
+// intensity left after distance and cone falloff.
+struct LightSample
+{
+    Vec3f direction;
+    float intensity;
+};
+
 class Light
 {
 public:
     explicit Light(const Vec3f& direction);
     Light(const Vec3f& direction, const Vec3f& color, float intensity);
 
+    // Inverse-square falloff, windowed to reach exactly zero at `range`.
+    static Light point(const Vec3f& position, const Vec3f& color, float intensity, float range);
+    // A point light restricted to a cone around `direction`, fading between
+    // the inner and outer half-angles.
+    static Light spot(const Vec3f& position, const Vec3f& direction, const Vec3f& color, float intensity,
+                      float range, float inner_angle_deg, float outer_angle_deg);
+
+    [[nodiscard]] LightType get_type() const { return type_; }
     [[nodiscard]] Vec3f get_direction() const { return direction_; }
+    [[nodiscard]] Vec3f get_position() const { return position_; }
     [[nodiscard]] Vec3f get_color() const { return color_; }
     [[nodiscard]] float get_intensity() const { return intensity_; }
+    // Infinite for directional lights.
+    [[nodiscard]] float get_range() const { return range_; }
+
+    [[nodiscard]] LightSample illuminate(const Vec3f& point) const;
+    // Upper bound on illuminate().intensity anywhere: the inverse-square term
+    // is clamped at a minimum distance, not at unit distance.
+    [[nodiscard]] float max_intensity() const;
 
 private:
+    LightType type_ = LightType::Directional;
     Vec3f direction_;
     Vec3f color_;
     float intensity_;
+    Vec3f position_;
+    float range_;
+    float cos_inner_ = -1.0f;
+    float cos_outer_ = -1.0f;
 };
@@ -0,0 +1,111 @@
+#include "light_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "trace.h"
+
+LightGrid::LightGrid(int width, int height)
+    : width_(width),
+      height_(height),
+      tiles_x_((width + kTileSize - 1) / kTileSize),
+      tiles_y_((height + kTileSize - 1) / kTileSize),
+      offsets_(static_cast<size_t>(tiles_x_) * tiles_y_ + 1, 0)
+{
+}
+
+LightGrid::TileRect LightGrid::screen_tiles(const Light& light, const Camera& camera) const
+{
+    const TileRect full_screen{0, 0, tiles_x_ - 1, tiles_y_ - 1};
+    if (light.get_type() == LightType::Directional)
+    {
+        return full_screen;
+    }
+
+    // Screen bounds of the box around the light's range. If any corner is
+    // behind the camera the projection folds over, so fall back to every tile.
+    const Vec3f center = light.get_position();
+    const float range = light.get_range();
+    float min_x = std::numeric_limits<float>::max();
+    float min_y = std::numeric_limits<float>::max();
+    float max_x = std::numeric_limits<float>::lowest();
+    float max_y = std::numeric_limits<float>::lowest();
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        const Vec3f offset((corner & 1) ? range : -range,
+                           (corner & 2) ? range : -range,
+                           (corner & 4) ? range : -range);
+        const Vec4f projected = camera.project_homogeneous(center + offset);
+        if (projected.w <= 0.0f)
+        {
+            return full_screen;
+        }
+        min_x = std::min(min_x, projected.x);
+        min_y = std::min(min_y, projected.y);
+        max_x = std::max(max_x, projected.x);
+        max_y = std::max(max_y, projected.y);
+    }
+
+    if (max_x < 0.0f || max_y < 0.0f || min_x >= static_cast<float>(width_) || min_y >= static_cast<float>(height_))
+    {
+        return {0, 0, -1, -1};
+    }
+    return {
+        std::max(0, static_cast<int>(min_x) / kTileSize),
+        std::max(0, static_cast<int>(min_y) / kTileSize),
+        std::min(tiles_x_ - 1, static_cast<int>(max_x) / kTileSize),
+        std::min(tiles_y_ - 1, static_cast<int>(max_y) / kTileSize)
+    };
+}
+
+void LightGrid::build(const std::vector<Light>& lights, const Camera& camera)
+{
+    const trace::Scope scope("bin lights");
+    if (lights.size() > std::numeric_limits<uint16_t>::max())
+    {
+        throw std::runtime_error("LightGrid supports at most 65535 lights");
+    }
+
+    rects_.resize(lights.size());
+    std::fill(offsets_.begin(), offsets_.end(), 0u);
+
+    // Count per tile (shifted by one), prefix-sum into offsets, then fill.
+    for (size_t i = 0; i < lights.size(); ++i)
+    {
+        const TileRect rect = screen_tiles(lights[i], camera);
+        rects_[i] = rect;
+        for (int tile_y = rect.y0; tile_y <= rect.y1; ++tile_y)
+        {
+            for (int tile_x = rect.x0; tile_x <= rect.x1; ++tile_x)
+            {
+                ++offsets_[static_cast<size_t>(tile_y) * tiles_x_ + tile_x + 1];
+            }
+        }
+    }
+    for (size_t tile = 1; tile < offsets_.size(); ++tile)
+    {
+        offsets_[tile] += offsets_[tile - 1];
+    }
+
+    indices_.resize(offsets_.back());
+    for (size_t i = 0; i < lights.size(); ++i)
+    {
+        const TileRect& rect = rects_[i];
+        for (int tile_y = rect.y0; tile_y <= rect.y1; ++tile_y)
+        {
+            for (int tile_x = rect.x0; tile_x <= rect.x1; ++tile_x)
+            {
+                // offsets_[tile] doubles as the tile's write cursor here ...
+                indices_[offsets_[static_cast<size_t>(tile_y) * tiles_x_ + tile_x]++] = static_cast<uint16_t>(i);
+            }
+        }
+    }
+    // ... which leaves every entry pointing at the next tile's start.
+    for (size_t tile = offsets_.size() - 1; tile > 0; --tile)
+    {
+        offsets_[tile] = offsets_[tile - 1];
+    }
+    offsets_[0] = 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "camera.h"
+#include "light.h"
+
+// Per-screen-tile light lists. build() bins every light into the tiles its
+// range can reach on screen, so a fragment only iterates over the lights
+// that may affect it. Lists are stored back to back (one offset per tile)
+// and the storage is reused from frame to frame.
+class LightGrid
+{
+public:
+    static constexpr int kTileSize = 16;
+
+    LightGrid(int width, int height);
+
+    void build(const std::vector<Light>& lights, const Camera& camera);
+
+    // Indices into the light list passed to build().
+    [[nodiscard]] std::span<const uint16_t> lights_at(int x, int y) const
+    {
+        const size_t tile = static_cast<size_t>(y / kTileSize) * tiles_x_ + x / kTileSize;
+        return {indices_.data() + offsets_[tile], indices_.data() + offsets_[tile + 1]};
+    }
+
+    [[nodiscard]] int tiles_x() const { return tiles_x_; }
+    [[nodiscard]] int tiles_y() const { return tiles_y_; }
+    // Sum of all per-tile list lengths; a measure of how well culling works.
+    [[nodiscard]] size_t total_entries() const { return indices_.size(); }
+
+private:
+    struct TileRect
+    {
+        int x0;
+        int y0;
+        int x1;
+        int y1;
+    };
+
+    [[nodiscard]] TileRect screen_tiles(const Light& light, const Camera& camera) const;
+
+    int width_;
+    int height_;
+    int tiles_x_;
+    int tiles_y_;
+    std::vector<TileRect> rects_;
+    std::vector<uint32_t> offsets_;
+    std::vector<uint16_t> indices_;
+};
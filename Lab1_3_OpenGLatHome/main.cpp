@@ -1,27 +1,50 @@
-#define STB_IMAGE_IMPLEMENTATION
-#include "libs/stb_image.h"
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "libs/stb_image_write.h"
-
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <limits>
 #include <numbers>
+#include <optional>
 #include <stdexcept>
+#include <string_view>
+#include <thread>
 #include <vector>
 
+#include "alloc_counter.h"
+#include "depth_export.h"
+#include "frame_scheduler.h"
+#include "framebuffer.h"
+#include "gbuffer.h"
 #include "geometry.h"
+#include "image_compare.h"
+#include "image_io.h"
+#include "image_writer.h"
 #include "model.h"
+#include "render_stats.h"
 #include "renderer.h"
+#include "sequence_writer.h"
+#include "visibility_buffer.h"
 #include "camera.h"
 #include "shader.h"
+#include "shadow_map.h"
 #include "texture.h"
+#include "trace.h"
 #include "light.h"
+#include "light_grid.h"
+#include "material.h"
 #include "libs/tgaimage.h"
 
+// Set by CMake; recorded in benchmark reports.
+#ifndef LAB_BUILD_ID
+#define LAB_BUILD_ID "unknown"
+#endif
+#ifndef LAB_BUILD_CONFIG
+#define LAB_BUILD_CONFIG ""
+#endif
+
 namespace
 {
     constexpr int kWidth = 800;
@@ -33,87 +56,485 @@ namespace
     const String kColorBufferPng = "output.png";
     const String kDepthBufferTga = "zbuffer.tga";
     const String kDepthBufferPng = "zbuffer.png";
+    const String kDepthBufferPgm16 = "zbuffer.pgm";
+    const String kOverdrawPng = "overdraw.png";
+    const String kOverdrawTilesCsv = "overdraw_tiles.csv";
+    const String kGoldenDir = "golden/";
+
+    constexpr std::string_view kUsage =
+        "usage: Lab1_3_OpenGLatHome [options]\n"
+        "  --model PATH              render this OBJ with its MTL materials\n"
+        "  --deferred | --visibility | --depth-prepass\n"
+        "                            render mode (default forward)\n"
+        "  --fast-math               approximate shading kernels\n"
+        "  --shadows, --shadow-pcf R directional shadows, PCF radius R\n"
+        "  --point-lights N          N extra point and spot lights\n"
+        "  --depth16                 also write zbuffer.pgm\n"
+        "  --sequence PATH           turntable into one GIF/APNG/Y4M file\n"
+        "  --encoder-threads N, --frame-workers N, --tile-workers N\n"
+        "  --stats, --overdraw       rasterizer counters, overdraw heatmap\n"
+        "  --timings, --trace PATH   per-stage timings, Chrome trace\n"
+        "  --benchmark PATH          benchmark scenes, JSON report at PATH\n"
+        "  --benchmark-frames N, --update-golden, --golden-psnr DB, --golden-max-diff N\n";
+
+    constexpr int kSequenceFps = 10;
+    constexpr int kShadowMapSize = 1024;
 
     const Light kLight(Vec3f(0.0f, 0.0f, -1.0f), {1, 1, 1}, 1.5);
 
-    struct Framebuffer
+    enum class RenderMode
+    {
+        Forward,
+        // G-buffer, then one lighting pass over the visible pixels.
+        Deferred,
+        // Triangle ids only, then one shading pass over the visible pixels.
+        Visibility,
+        // Depth only, then forward shading of the fragments at that depth.
+        DepthPrepass
+    };
+
+    struct RenderSettings
+    {
+        ShadingPrecision precision = ShadingPrecision::Exact;
+        unsigned encoder_threads = AsyncImageWriter::default_thread_count();
+        // 0 lets plan_parallelism() decide from the core count.
+        unsigned frame_workers = 0;
+        unsigned tile_workers = 0;
+        // Also writes the depth buffer as a 16-bit PGM.
+        bool depth16 = false;
+        // When set, the turntable goes into this one GIF/APNG/Y4M file instead of gif/*.png.
+        String sequence_path;
+        // Extra point and spot lights for the final render, culled per tile.
+        int point_lights = 0;
+        // Shadows from the directional light; PCF radius 0 gives hard edges.
+        bool shadows = false;
+        int shadow_pcf_radius = 1;
+        RenderMode mode = RenderMode::Forward;
+        // Renders this OBJ with its MTL materials instead of the default model.
+        String model_path;
+        // Rasterizer counters for the final render; the heatmap implies them.
+        bool stats = false;
+        bool overdraw = false;
+        // Per-stage wall-clock totals; the trace also keeps every event.
+        bool timings = false;
+        String trace_path;
+        // When set, renders the benchmark scenes instead and writes a JSON
+        // report here; frame 0 of every run is checked against golden/.
+        String benchmark_path;
+        int benchmark_frames = 8;
+        // Rewrites the golden images from this build instead of comparing.
+        bool update_golden = false;
+        // Override the mode's bound from golden_tolerance().
+        std::optional<double> golden_min_psnr;
+        std::optional<int> golden_max_diff;
+    };
+
+    // Thread counts: a whole number from 1 to 4x the hardware threads, so a
+    // typo or "-1" cannot turn into billions of workers.
+    unsigned parse_thread_count(std::string_view option, const char* text)
     {
-        Framebuffer()
-            : color(kWidth, kHeight, TGAImage::RGB),
-              depth(kWidth * kHeight, std::numeric_limits<float>::lowest())
+        const unsigned cap = 4 * std::max(1u, std::thread::hardware_concurrency());
+        size_t used = 0;
+        long long value = 0;
+        try
         {
+            value = std::stoll(text, &used);
         }
+        catch (const std::logic_error&)
+        {
+            used = 0;
+        }
+        if (used == 0 || text[used] != '\0' || value < 1 || value > cap)
+        {
+            throw std::runtime_error(String(option) + " needs a count from 1 to " + std::to_string(cap) +
+                                     ", got \"" + text + "\"");
+        }
+        return static_cast<unsigned>(value);
+    }
 
-        TGAImage color;
-        std::vector<float> depth;
-    };
+    RenderSettings parse_settings(int argc, char** argv)
+    {
+        RenderSettings settings;
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string_view arg = argv[i];
+            if (arg == "--fast-math")
+            {
+                settings.precision = ShadingPrecision::Fast;
+            }
+            else if (arg == "--depth16")
+            {
+                settings.depth16 = true;
+            }
+            else if (arg == "--sequence" && i + 1 < argc)
+            {
+                settings.sequence_path = argv[++i];
+            }
+            else if (arg == "--deferred")
+            {
+                settings.mode = RenderMode::Deferred;
+            }
+            else if (arg == "--visibility")
+            {
+                settings.mode = RenderMode::Visibility;
+            }
+            else if (arg == "--depth-prepass")
+            {
+                settings.mode = RenderMode::DepthPrepass;
+            }
+            else if (arg == "--model" && i + 1 < argc)
+            {
+                settings.model_path = argv[++i];
+            }
+            else if (arg == "--stats")
+            {
+                settings.stats = true;
+            }
+            else if (arg == "--overdraw")
+            {
+                settings.stats = true;
+                settings.overdraw = true;
+            }
+            else if (arg == "--timings")
+            {
+                settings.timings = true;
+            }
+            else if (arg == "--trace" && i + 1 < argc)
+            {
+                settings.timings = true;
+                settings.trace_path = argv[++i];
+            }
+            else if (arg == "--benchmark" && i + 1 < argc)
+            {
+                settings.benchmark_path = argv[++i];
+            }
+            else if (arg == "--benchmark-frames" && i + 1 < argc)
+            {
+                settings.benchmark_frames = std::max(1, std::stoi(argv[++i]));
+            }
+            else if (arg == "--update-golden")
+            {
+                settings.update_golden = true;
+            }
+            else if (arg == "--golden-psnr" && i + 1 < argc)
+            {
+                settings.golden_min_psnr = std::stod(argv[++i]);
+            }
+            else if (arg == "--golden-max-diff" && i + 1 < argc)
+            {
+                settings.golden_max_diff = std::stoi(argv[++i]);
+            }
+            else if (arg == "--shadows")
+            {
+                settings.shadows = true;
+            }
+            else if (arg == "--shadow-pcf" && i + 1 < argc)
+            {
+                settings.shadows = true;
+                settings.shadow_pcf_radius = std::stoi(argv[++i]);
+            }
+            else if (arg == "--point-lights" && i + 1 < argc)
+            {
+                settings.point_lights = std::stoi(argv[++i]);
+            }
+            else if (arg == "--encoder-threads" && i + 1 < argc)
+            {
+                settings.encoder_threads = parse_thread_count(arg, argv[++i]);
+            }
+            else if (arg == "--frame-workers" && i + 1 < argc)
+            {
+                settings.frame_workers = parse_thread_count(arg, argv[++i]);
+            }
+            else if (arg == "--tile-workers" && i + 1 < argc)
+            {
+                settings.tile_workers = parse_thread_count(arg, argv[++i]);
+            }
+            else
+            {
+                throw std::runtime_error("Unknown option: " + std::string(arg));
+            }
+        }
+        if (!settings.model_path.empty() && (settings.shadows || settings.point_lights > 0))
+        {
+            throw std::runtime_error("--shadows and --point-lights need the default model");
+        }
+        if (!settings.benchmark_path.empty() &&
+            (!settings.model_path.empty() || settings.shadows || settings.point_lights > 0))
+        {
+            throw std::runtime_error("--benchmark renders its own scenes without --model, --shadows or --point-lights");
+        }
+        return settings;
+    }
 
-    void render_model(const Model& model, Framebuffer& framebuffer, IShader& shader)
+    template <renderer::DepthTest Test = renderer::DepthTest::Greater>
+    void render_model(const Model& model,
+                      Framebuffer& framebuffer,
+                      IShader& shader,
+                      const renderer::RowRange& rows = {})
     {
         for (int face_index = 0; face_index < model.nfaces(); ++face_index)
         {
-            std::array<Vec3f, 3> screen_vertices{};
+            std::array<Vec4f, 3> screen_vertices{};
             for (int vertex_index = 0; vertex_index < 3; ++vertex_index)
             {
                 screen_vertices[vertex_index] = shader.vertex(face_index, vertex_index);
             }
 
-            renderer::barycentric_triangle(
+            renderer::barycentric_triangle<Test>(
                 screen_vertices,
                 framebuffer.color,
                 framebuffer.depth,
-                shader);
+                shader,
+                rows);
         }
     }
 
-    void dump_depth_buffer(const std::vector<float>& depth, const char* file_path)
+    // kLight plus `count` coloured lights on a spiral around the model; every
+    // fourth one is a spot aimed at the target.
+    std::vector<Light> scene_lights(const Camera& camera, int count)
     {
-        TGAImage depth_image(kWidth, kHeight, TGAImage::GRAYSCALE);
-        for (int x = 0; x < kWidth; ++x)
+        constexpr float radius = 0.2f;
+        constexpr float range = 0.12f;
+        constexpr float intensity = 0.003f;
+
+        std::vector<Light> lights{kLight};
+        const Vec3f target = camera.get_target();
+        for (int i = 0; i < count; ++i)
         {
-            for (int y = 0; y < kHeight; ++y)
+            const float t = (i + 0.5f) / static_cast<float>(count);
+            const float angle = 2.0f * std::numbers::pi_v<float> * 3.0f * t;
+            const Vec3f position = target + Vec3f(std::sin(angle) * radius, 0.35f * t - 0.18f, std::cos(angle) * radius);
+            const Vec3f color(0.5f + 0.5f * std::cos(angle),
+                              0.5f + 0.5f * std::cos(angle - 2.0f * std::numbers::pi_v<float> / 3.0f),
+                              0.5f + 0.5f * std::cos(angle + 2.0f * std::numbers::pi_v<float> / 3.0f));
+            if (i % 4 == 3)
+            {
+                lights.push_back(Light::spot(position, target - position, color, 2.0f * intensity, 2.0f * range,
+                                             15.0f, 25.0f));
+            }
+            else
             {
-                const int index = x + y * kWidth;
-                const float depth_value = depth.at(index);
-                const float clamped = std::clamp(depth_value, 0.0f, 1.0f);
-                const auto value = static_cast<unsigned char>(clamped * 255.0f);
-                depth_image.set(x, y, TGAColor(value, 1));
+                lights.push_back(Light::point(position, color, intensity, range));
             }
         }
+        return lights;
+    }
 
-        depth_image.flip_vertically();
-        depth_image.write_tga_file(file_path);
+    // The extra buffers a render mode needs, reused from frame to frame.
+    struct PassBuffers
+    {
+        PassBuffers(RenderMode mode, int width, int height)
+            : mode(mode)
+        {
+            if (mode == RenderMode::Deferred)
+            {
+                gbuffer.emplace(width, height);
+            }
+            else if (mode == RenderMode::Visibility)
+            {
+                visibility.emplace(width, height);
+            }
+        }
+
+        // Clears the buffers. Modes with a shader-free first pass also project
+        // every vertex once here, on the frame's lead thread, for all bands
+        // to share.
+        void begin_frame(const Model& model, const Camera& camera)
+        {
+            if (gbuffer)
+            {
+                gbuffer->clear();
+            }
+            if (visibility)
+            {
+                if (model.nfaces() > VisibilityBuffer::kMaxTriangles)
+                {
+                    throw std::runtime_error("Too many triangles for the visibility buffer");
+                }
+                visibility->clear();
+            }
+            if (mode == RenderMode::Visibility || mode == RenderMode::DepthPrepass)
+            {
+                const trace::Scope scope("vertex");
+                projected_vertices.resize(model.nverts());
+                for (size_t i = 0; i < projected_vertices.size(); ++i)
+                {
+                    projected_vertices[i] = camera.project_homogeneous(model.vert(static_cast<int>(i)));
+                }
+            }
+        }
+
+        // Face `face_index` gathered from projected_vertices.
+        [[nodiscard]] std::array<Vec4f, 3> projected_face(const Model& model, int face_index) const
+        {
+            const std::vector<int>& face = model.face(face_index);
+            return {projected_vertices[face[0]], projected_vertices[face[1]], projected_vertices[face[2]]};
+        }
+
+        RenderMode mode;
+        std::optional<GBuffer> gbuffer;
+        std::optional<VisibilityBuffer> visibility;
+        std::vector<Vec4f> projected_vertices;
+    };
+
+    template <typename Shader>
+    void draw(const Model& model,
+              Framebuffer& framebuffer,
+              PassBuffers& buffers,
+              Shader& shader,
+              const renderer::RowRange& rows = {})
+    {
+        if (buffers.mode != RenderMode::Forward && shader.may_discard())
+        {
+            throw std::runtime_error("Deferred and visibility rendering need a shader that never discards");
+        }
+        switch (buffers.mode)
+        {
+        case RenderMode::Forward:
+        {
+            // Vertex, raster and shading work are interleaved per triangle.
+            const trace::Scope scope("raster+shade");
+            render_model(model, framebuffer, shader, rows);
+            break;
+        }
+        case RenderMode::Deferred:
+        {
+            {
+                const trace::Scope scope("raster g-buffer");
+                for (int face_index = 0; face_index < static_cast<int>(model.nfaces()); ++face_index)
+                {
+                    std::array<Vec4f, 3> screen_vertices{};
+                    for (int vertex_index = 0; vertex_index < 3; ++vertex_index)
+                    {
+                        screen_vertices[vertex_index] = shader.vertex(face_index, vertex_index);
+                    }
+                    renderer::gbuffer_triangle(screen_vertices, *buffers.gbuffer, framebuffer.depth, shader, rows);
+                }
+            }
+            const trace::Scope scope("shade");
+            renderer::shade_gbuffer(*buffers.gbuffer, framebuffer.color, shader, rows);
+            break;
+        }
+        case RenderMode::Visibility:
+        {
+            {
+                const trace::Scope scope("raster visibility");
+                for (int face_index = 0; face_index < static_cast<int>(model.nfaces()); ++face_index)
+                {
+                    renderer::visibility_triangle(buffers.projected_face(model, face_index), *buffers.visibility,
+                                                  framebuffer.depth, VisibilityBuffer::pack(0, face_index), rows);
+                }
+            }
+            const trace::Scope scope("shade");
+            renderer::shade_visibility(*buffers.visibility, framebuffer.color, shader, 0, rows);
+            break;
+        }
+        case RenderMode::DepthPrepass:
+        {
+            {
+                const trace::Scope scope("raster depth");
+                for (int face_index = 0; face_index < static_cast<int>(model.nfaces()); ++face_index)
+                {
+                    renderer::depth_triangle(buffers.projected_face(model, face_index), framebuffer.depth, rows);
+                }
+            }
+            const trace::Scope scope("raster+shade");
+            render_model<renderer::DepthTest::Equal>(model, framebuffer, shader, rows);
+            break;
+        }
+        }
     }
 
-    void convert_tga_to_png(const char* input_path, const char* output_path)
+    Camera default_camera(int width, int height)
     {
-        int width = 0;
-        int height = 0;
-        int channels = 0;
-        unsigned char* data = stbi_load(input_path, &width, &height, &channels, 0);
-        if (!data)
+        return Camera(
+            Vec3f(0.0f, 0.5f, 0.3f),
+            Vec3f(0.0f, 0.2f, 0.0f),
+            Vec3f(0.0f, 1.0f, 0.0f),
+            60.0f,
+            static_cast<float>(width) / static_cast<float>(height),
+            0.1f,
+            100.0f,
+            width,
+            height);
+    }
+
+    // Looks at the model's bounds from above and in front, like the default
+    // camera does for the default model.
+    Camera framing_camera(const Model& model, int width, int height)
+    {
+        Vec3f min_corner(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                         std::numeric_limits<float>::max());
+        Vec3f max_corner(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(),
+                         std::numeric_limits<float>::lowest());
+        for (int i = 0; i < static_cast<int>(model.nverts()); ++i)
         {
-            throw std::runtime_error("Failed to load " + std::string(input_path));
+            const Vec3f& v = model.vert(i);
+            min_corner = Vec3f(std::min(min_corner.x, v.x), std::min(min_corner.y, v.y), std::min(min_corner.z, v.z));
+            max_corner = Vec3f(std::max(max_corner.x, v.x), std::max(max_corner.y, v.y), std::max(max_corner.z, v.z));
+        }
+        const Vec3f center = (min_corner + max_corner) * 0.5f;
+        const float radius = (max_corner - min_corner).length() * 0.5f;
+        // Close to the distance at which the bounding sphere fills the 60
+        // degree field of view; boxes are rarely full, so slightly nearer.
+        const Vec3f position = center + Vec3f(0.0f, 1.0f, 1.0f).normalized() * (1.6f * radius);
+        return Camera(position, center, Vec3f(0.0f, 1.0f, 0.0f), 60.0f,
+                      static_cast<float>(width) / static_cast<float>(height),
+                      0.01f * radius, 10.0f * radius, width, height);
+    }
+
+    void print_stats(const RenderStats& stats, const OverdrawMap* overdraw)
+    {
+        std::cout << "# triangles: " << stats.triangles_submitted << " submitted, "
+            << stats.triangles_culled << " culled, " << stats.triangles_rasterized << " rasterized\n"
+            << "# pixels: " << stats.pixels_tested << " tested, " << stats.pixels_passed << " passed, "
+            << stats.pixels_shaded << " shaded\n";
+        if (!overdraw)
+        {
+            std::cout << std::flush;
+            return;
         }
 
-        const int stride_in_bytes = width * channels;
-        const int result = stbi_write_png(output_path, width, height, channels, data, stride_in_bytes);
-        stbi_image_free(data);
-        if (result == 0)
+        uint64_t covered = 0;
+        for (int y = 0; y < overdraw->height(); ++y)
         {
-            throw std::runtime_error("Failed to write PNG file: " + std::string(output_path));
+            for (int x = 0; x < overdraw->width(); ++x)
+            {
+                covered += overdraw->at(x, y) != 0 ? 1 : 0;
+            }
+        }
+        int hottest_x = 0;
+        int hottest_y = 0;
+        uint64_t hottest = 0;
+        for (int tile_y = 0; tile_y < overdraw->tiles_y(); ++tile_y)
+        {
+            for (int tile_x = 0; tile_x < overdraw->tiles_x(); ++tile_x)
+            {
+                const uint64_t total = overdraw->tile_total(tile_x, tile_y);
+                if (total > hottest)
+                {
+                    hottest = total;
+                    hottest_x = tile_x;
+                    hottest_y = tile_y;
+                }
+            }
         }
+        std::cout << "# overdraw: " << (covered ? static_cast<double>(stats.pixels_shaded) / covered : 0.0)
+            << " shaded per covered pixel, at most " << overdraw->max_count() << "; hottest "
+            << OverdrawMap::kTileSize << "x" << OverdrawMap::kTileSize << " tile (" << hottest_x << ", "
+            << hottest_y << ") with " << hottest << " fragments" << std::endl;
     }
 
-    void render_rotation_sequence(const Model& model,
-                                  const Texture& texture,
-                                  const Camera& start_camera,
-                                  const String& output_prefix)
+    struct TurntableView
+    {
+        Camera camera;
+        Light light;
+    };
+
+    TurntableView turntable_view(const Camera& start_camera, int frame, int frame_count)
     {
-        constexpr int frame_count = 20;
         constexpr float pulse_amplitude = 0.3f;
         constexpr float pulse_cycles = 2.0f;
-        const String output_dir = "gif/";
 
         const Vec3f target = start_camera.get_target();
         const Vec3f start_position = start_camera.get_position();
@@ -123,20 +544,19 @@ namespace
         const float base_horizontal_distance = std::sqrt(to_camera.x * to_camera.x + to_camera.z * to_camera.z);
         const float start_angle = std::atan2(to_camera.x, to_camera.z);
 
-        for (int frame = 0; frame < frame_count; ++frame)
-        {
-            std::cout << frame << std::endl;
-            const float progress = static_cast<float>(frame) / frame_count;
-            const float pulse = 1.0f + pulse_amplitude * std::sin(
-                progress * pulse_cycles * 2.0f * std::numbers::pi_v<float>);
+        const float progress = static_cast<float>(frame) / frame_count;
+        const float pulse = 1.0f + pulse_amplitude * std::sin(
+            progress * pulse_cycles * 2.0f * std::numbers::pi_v<float>);
 
-            const float angle = start_angle + (2.0f * std::numbers::pi_v<float> * frame) / frame_count;
-            const float horizontal_distance = base_horizontal_distance * pulse;
-            const float x = std::sin(angle) * horizontal_distance;
-            const float z = std::cos(angle) * horizontal_distance;
-            const Vec3f new_position = target + Vec3f(x, base_height, z);
+        const float angle = start_angle + (2.0f * std::numbers::pi_v<float> * frame) / frame_count;
+        const float horizontal_distance = base_horizontal_distance * pulse;
+        const float x = std::sin(angle) * horizontal_distance;
+        const float z = std::cos(angle) * horizontal_distance;
+        const Vec3f new_position = target + Vec3f(x, base_height, z);
 
-            Camera camera(
+        const Vec3f light_direction = (target - new_position).normalized();
+        return {
+            Camera(
                 new_position,
                 target,
                 start_camera.get_up(),
@@ -145,50 +565,591 @@ namespace
                 start_camera.get_near_plane(),
                 start_camera.get_far_plane(),
                 start_camera.get_screen_width(),
-                start_camera.get_screen_height());
+                start_camera.get_screen_height()),
+            Light(light_direction, kLight.get_color(), kLight.get_intensity())
+        };
+    }
 
-            const Vec3f light_direction = (target - new_position).normalized();
-            const Light light(light_direction, kLight.get_color(), kLight.get_intensity());
+    void render_rotation_sequence(const Model& model,
+                                  const Texture* texture,
+                                  const MaterialSet* materials,
+                                  const Camera& start_camera,
+                                  const String& output_prefix,
+                                  const RenderSettings& settings)
+    {
+        constexpr int frame_count = 20;
+        const String output_dir = "gif/";
+
+        ParallelPlan plan = plan_parallelism(frame_count, std::thread::hardware_concurrency());
+        if (settings.frame_workers != 0)
+        {
+            plan.frame_workers = settings.frame_workers;
+        }
+        if (settings.tile_workers != 0)
+        {
+            plan.tile_workers = settings.tile_workers;
+        }
+
+        // Allocation counts are only meaningful once every pool, queue and
+        // thread-local scratch buffer has been created.
+        constexpr int warmup_frames = frame_count / 2;
+        uint64_t allocations_after_warmup = 0;
+
+        FramebufferPool pool(kWidth, kHeight);
+        std::vector<std::unique_ptr<Framebuffer>> framebuffers(plan.frame_workers);
+        std::vector<std::unique_ptr<ShadowMap>> shadow_maps(plan.frame_workers);
+        std::vector<std::unique_ptr<PassBuffers>> pass_buffers(plan.frame_workers);
+        for (std::unique_ptr<PassBuffers>& buffers : pass_buffers)
+        {
+            buffers = std::make_unique<PassBuffers>(settings.mode, kWidth, kHeight);
+        }
+        if (settings.shadows)
+        {
+            for (std::unique_ptr<ShadowMap>& shadow_map : shadow_maps)
+            {
+                shadow_map = std::make_unique<ShadowMap>(kShadowMapSize, settings.shadow_pcf_radius);
+            }
+        }
+        AsyncImageWriter writer(settings.encoder_threads);
+        std::optional<SequenceWriter> sequence;
+        if (!settings.sequence_path.empty())
+        {
+            sequence.emplace(settings.sequence_path, kWidth, kHeight, kSequenceFps);
+        }
 
-            Framebuffer framebuffer{};
-            PhongShader shader(model, camera, light, &texture);
-            render_model(model, framebuffer, shader);
+        FrameCallbacks callbacks;
+        callbacks.begin = [&](unsigned group, int frame)
+        {
+            if (frame == warmup_frames)
+            {
+                allocations_after_warmup = alloc_counter::allocations();
+            }
+            std::cout << std::to_string(frame) + "\n" << std::flush;
+            framebuffers[group] = pool.acquire();
+            const TurntableView view = turntable_view(start_camera, frame, frame_count);
+            pass_buffers[group]->begin_frame(model, view.camera);
+            if (shadow_maps[group])
+            {
+                shadow_maps[group]->render(model, view.light);
+            }
+        };
+        callbacks.render = [&](unsigned group, int frame, unsigned band, unsigned band_count)
+        {
+            const TurntableView view = turntable_view(start_camera, frame, frame_count);
+            // Bands follow depth tile rows, so no two threads fill the same tile.
+            constexpr int tile = DepthTarget::kTileSize;
+            constexpr int tile_rows = (kHeight + tile - 1) / tile;
+            const renderer::RowRange rows{static_cast<int>(band * tile_rows / band_count) * tile,
+                                          static_cast<int>((band + 1) * tile_rows / band_count) * tile};
+            if (materials)
+            {
+                MaterialShader shader(model, view.camera, view.light, *materials);
+                draw(model, *framebuffers[group], *pass_buffers[group], shader, rows);
+                return;
+            }
+            PhongShader shader(model, view.camera, view.light, texture, 0.1f, 0.5f, 32.0f, settings.precision);
+            shader.set_shadow_map(shadow_maps[group].get());
+            draw(model, *framebuffers[group], *pass_buffers[group], shader, rows);
+        };
+        callbacks.end = [&](unsigned group, int frame)
+        {
+            Framebuffer* framebuffer = framebuffers[group].release();
+            auto release = [&pool, framebuffer]
+            {
+                pool.release(std::unique_ptr<Framebuffer>(framebuffer));
+            };
+            if (sequence)
+            {
+                sequence->submit(frame, framebuffer->resolve(), true, release);
+                return;
+            }
 
-            framebuffer.color.flip_vertically();
-            const String frame_tga = "debug.tga";
             const String frame_png = output_dir + output_prefix + "_" + std::to_string(frame) + ".png";
-            framebuffer.color.write_tga_file(frame_tga.c_str());
-            convert_tga_to_png(frame_tga.c_str(), frame_png.c_str());
+            writer.submit(framebuffer->resolve(), frame_png, true, release);
+        };
+
+        run_frames(frame_count, plan, callbacks);
+        if (sequence)
+        {
+            sequence->finish();
+        }
+        writer.finish();
+
+        if (alloc_counter::enabled())
+        {
+            std::cout << "# heap allocations in frames " << warmup_frames << ".." << frame_count - 1 << ": "
+                << alloc_counter::allocations() - allocations_after_warmup
+                << " (framebuffers allocated: " << pool.allocated() << ")" << std::endl;
         }
     }
+
+    struct BenchmarkScene
+    {
+        const char* name;
+        String model_path;
+        // Phong with this texture; empty lights the model's MTL materials.
+        String texture_path;
+        bool default_camera;
+    };
+
+    const std::array<BenchmarkScene, 3> kBenchmarkScenes{{
+        {"gabriel", kModelPath, kDiffuseTexturePath, true},
+        {"african_head", "carrot_soup/african_head.obj", "carrot_soup/african_head_diffuse.tga", false},
+        {"carrot_soup", "carrot_soup/carrot_soup.obj", "", false}
+    }};
+    constexpr std::array<int, 3> kBenchmarkSizes{256, 512, 800};
+
+    struct BenchmarkRun
+    {
+        String scene;
+        int width = 0;
+        int height = 0;
+        int frames = 0;
+        double seconds = 0.0;
+        std::vector<trace::StageTotal> stages;
+        String golden_path;
+        ImageDiff diff;
+        bool passed = true;
+        // Why the golden check could not compare at all (e.g. a missing or
+        // wrong-sized reference); empty when `diff` is valid.
+        String failure;
+    };
+
+    struct GoldenTolerance
+    {
+        double min_psnr_db;
+        int max_diff;
+    };
+
+    // The goldens are forward renders. Forward and the depth pre-pass match
+    // them exactly; the deferred G-buffer's quantized normals and the
+    // fast-math kernels move a few channels by 1. The visibility pass
+    // rebuilds each pixel's barycentrics from its triangle instead of
+    // stepping them across the triangle, so a few texels per frame (under
+    // 0.02% of the pixels) fetch a neighbouring texel and differ by up to ~40;
+    // the PSNR floor keeps that from hiding a change over a wider area.
+    GoldenTolerance golden_tolerance(const RenderSettings& settings)
+    {
+        GoldenTolerance tolerance = settings.mode == RenderMode::Visibility
+            ? GoldenTolerance{70.0, 48}
+            : GoldenTolerance{60.0, 1};
+        tolerance.min_psnr_db = settings.golden_min_psnr.value_or(tolerance.min_psnr_db);
+        tolerance.max_diff = settings.golden_max_diff.value_or(tolerance.max_diff);
+        return tolerance;
+    }
+
+    const char* mode_name(RenderMode mode)
+    {
+        switch (mode)
+        {
+        case RenderMode::Forward:
+            return "forward";
+        case RenderMode::Deferred:
+            return "deferred";
+        case RenderMode::Visibility:
+            return "visibility";
+        case RenderMode::DepthPrepass:
+            return "depth-prepass";
+        }
+        return "unknown";
+    }
+
+    const char* depth_format_name(DepthFormat format)
+    {
+        switch (format)
+        {
+        case DepthFormat::Float32:
+            return "float32";
+        case DepthFormat::Unorm24:
+            return "unorm24";
+        case DepthFormat::Unorm16:
+            return "unorm16";
+        }
+        return "unknown";
+    }
+
+    const char* color_format_name(PixelFormat format)
+    {
+        switch (format)
+        {
+        case PixelFormat::RGBA8:
+            return "rgba8";
+        case PixelFormat::RGB10A2:
+            return "rgb10a2";
+        }
+        return "unknown";
+    }
+
+    // The goldens are rendered by the default build; other depth and colour
+    // formats quantize differently and are not checked against them.
+    constexpr bool kGoldenFormats =
+        DepthTarget::kFormat == DepthFormat::Float32 && ColorTarget::kFormat == PixelFormat::RGBA8;
+
+    String golden_not_applicable()
+    {
+        return String("n/a for depth ") + depth_format_name(DepthTarget::kFormat) + ", colour " +
+            color_format_name(ColorTarget::kFormat);
+    }
+
+    // JSON has no infinity; identical images report a null PSNR.
+    void write_json_number(std::ostream& out, double value)
+    {
+        if (std::isfinite(value))
+        {
+            out << value;
+        }
+        else
+        {
+            out << "null";
+        }
+    }
+
+    void write_json_string(std::ostream& out, std::string_view text)
+    {
+        out << '"';
+        for (const char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out << '\\';
+            }
+            out << (static_cast<unsigned char>(c) < 0x20 ? ' ' : c);
+        }
+        out << '"';
+    }
+
+    void write_benchmark_report(const String& path, const RenderSettings& settings,
+                                const std::vector<BenchmarkRun>& runs, bool passed)
+    {
+        std::ofstream out(path);
+        if (!out)
+        {
+            throw std::runtime_error("Failed to open benchmark report: " + path);
+        }
+
+        const GoldenTolerance tolerance = golden_tolerance(settings);
+        out << "{\n  \"build\": {\"id\": \"" << LAB_BUILD_ID << "\", \"config\": \"" << LAB_BUILD_CONFIG
+            << "\", \"depth\": \"" << depth_format_name(DepthTarget::kFormat) << "\", \"colour\": \""
+            << color_format_name(ColorTarget::kFormat) << "\"},\n  \"mode\": \"" << mode_name(settings.mode)
+            << "\",\n  \"precision\": \"" << (settings.precision == ShadingPrecision::Fast ? "fast" : "exact")
+            << "\",\n  \"golden\": ";
+        if (kGoldenFormats)
+        {
+            out << "{\"min_psnr_db\": " << tolerance.min_psnr_db << ", \"max_diff\": " << tolerance.max_diff
+                << ", \"updated\": " << (settings.update_golden ? "true" : "false") << "}";
+        }
+        else
+        {
+            write_json_string(out, golden_not_applicable());
+        }
+        out << ",\n  \"runs\": [";
+        for (size_t i = 0; i < runs.size(); ++i)
+        {
+            const BenchmarkRun& run = runs[i];
+            out << (i == 0 ? "\n" : ",\n") << "    {\"scene\": \"" << run.scene << "\", \"width\": " << run.width
+                << ", \"height\": " << run.height << ", \"frames\": " << run.frames << ", \"seconds\": "
+                << run.seconds << ", \"fps\": " << run.frames / run.seconds << ",\n     \"stage_ms_per_frame\": {";
+            for (size_t s = 0; s < run.stages.size(); ++s)
+            {
+                out << (s == 0 ? "" : ", ") << "\"" << run.stages[s].name << "\": "
+                    << run.stages[s].total_ms / run.frames;
+            }
+            out << "},\n     \"golden\": ";
+            if (!kGoldenFormats)
+            {
+                write_json_string(out, golden_not_applicable());
+                out << '}';
+                continue;
+            }
+            out << "{\"image\": ";
+            write_json_string(out, run.golden_path);
+            if (run.failure.empty())
+            {
+                out << ", \"max_diff\": " << run.diff.max_diff << ", \"differing_pixels\": "
+                    << run.diff.differing_pixels << ", \"psnr_db\": ";
+                write_json_number(out, run.diff.psnr_db);
+            }
+            else
+            {
+                out << ", \"reason\": ";
+                write_json_string(out, run.failure);
+            }
+            out << ", \"pass\": " << (run.passed ? "true" : "false") << "}}";
+        }
+        out << "\n  ],\n  \"pass\": " << (passed ? "true" : "false") << "\n}\n";
+
+        if (!out)
+        {
+            throw std::runtime_error("Failed to write benchmark report: " + path);
+        }
+    }
+
+    // Renders every benchmark scene at every size on the calling thread:
+    // frame 0 is rendered once untimed and checked against (or written to)
+    // golden/<scene>_<w>x<h>.png, then `benchmark_frames` turntable frames
+    // are timed. Returns the process exit code: 1 when a check failed.
+    int run_benchmark(const RenderSettings& settings)
+    {
+        trace::enable();
+        if (settings.update_golden)
+        {
+            if (!kGoldenFormats)
+            {
+                throw std::runtime_error("--update-golden needs the default float32 depth and RGBA8 colour build");
+            }
+            std::filesystem::create_directories(kGoldenDir);
+        }
+
+        const GoldenTolerance tolerance = golden_tolerance(settings);
+        std::vector<BenchmarkRun> runs;
+        bool passed = true;
+        for (const BenchmarkScene& scene : kBenchmarkScenes)
+        {
+            const Model model(scene.model_path);
+            std::optional<Texture> texture;
+            std::optional<MaterialSet> materials;
+            if (!scene.texture_path.empty())
+            {
+                texture.emplace(scene.texture_path);
+            }
+            else
+            {
+                materials.emplace(model.materials());
+            }
+
+            for (const int size : kBenchmarkSizes)
+            {
+                const Camera start_camera = scene.default_camera
+                    ? default_camera(size, size)
+                    : framing_camera(model, size, size);
+                Framebuffer framebuffer(size, size);
+                PassBuffers pass_buffers(settings.mode, size, size);
+                auto render_frame = [&](int frame) -> const TGAImage&
+                {
+                    framebuffer.clear();
+                    const TurntableView view = turntable_view(start_camera, frame, settings.benchmark_frames);
+                    pass_buffers.begin_frame(model, view.camera);
+                    if (materials)
+                    {
+                        MaterialShader shader(model, view.camera, view.light, *materials);
+                        draw(model, framebuffer, pass_buffers, shader);
+                    }
+                    else
+                    {
+                        PhongShader shader(model, view.camera, view.light, &*texture, 0.1f, 0.5f, 32.0f,
+                                           settings.precision);
+                        draw(model, framebuffer, pass_buffers, shader);
+                    }
+                    return framebuffer.resolve();
+                };
+
+                BenchmarkRun run;
+                run.scene = scene.name;
+                run.width = size;
+                run.height = size;
+                run.frames = settings.benchmark_frames;
+                run.golden_path = kGoldenDir + scene.name + "_" + std::to_string(size) + "x" +
+                    std::to_string(size) + ".png";
+
+                const TGAImage& first_frame = render_frame(0);
+                if (settings.update_golden)
+                {
+                    image_io::write_image(first_frame, run.golden_path, true);
+                }
+                else if (kGoldenFormats)
+                {
+                    // A fresh or partial checkout fails the run, not the whole benchmark.
+                    try
+                    {
+                        run.diff = image_compare::compare_with_file(first_frame, true, run.golden_path);
+                        run.passed = run.diff.within(tolerance.min_psnr_db, tolerance.max_diff);
+                    }
+                    catch (const std::runtime_error& error)
+                    {
+                        run.failure = error.what();
+                        run.passed = false;
+                    }
+                    passed = passed && run.passed;
+                }
+
+                trace::reset();
+                const auto start = std::chrono::steady_clock::now();
+                for (int frame = 0; frame < run.frames; ++frame)
+                {
+                    render_frame(frame);
+                }
+                run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                run.stages = trace::stage_totals();
+
+                std::cout << "# " << run.scene << " " << size << "x" << size << ": " << run.frames / run.seconds
+                    << " fps, golden ";
+                if (!kGoldenFormats)
+                {
+                    std::cout << golden_not_applicable();
+                }
+                else if (settings.update_golden)
+                {
+                    std::cout << "updated";
+                }
+                else if (!run.failure.empty())
+                {
+                    std::cout << "FAILED (" << run.failure << ")";
+                }
+                else
+                {
+                    std::cout << (run.passed ? "ok" : "FAILED") << " (max diff " << run.diff.max_diff << ", " << run.diff.differing_pixels
+                        << " pixels, PSNR " << run.diff.psnr_db << " dB)";
+                }
+                std::cout << std::endl;
+                runs.push_back(std::move(run));
+            }
+        }
+
+        write_benchmark_report(settings.benchmark_path, settings, runs, passed);
+        return passed ? 0 : 1;
+    }
 }
 
-int main()
+int main(int argc, char** argv)
 {
-    const Model model(kModelPath);
-    const Texture diffuse_texture(kDiffuseTexturePath);
-    const Camera camera(
-        Vec3f(0.0f, 0.5f, 0.3f),
-        Vec3f(0.0f, 0.2f, 0.0f),
-        Vec3f(0.0f, 1.0f, 0.0f),
-        60.0f,
-        static_cast<float>(kWidth) / static_cast<float>(kHeight),
-        0.1f,
-        100.0f,
-        kWidth,
-        kHeight);
-
-    render_rotation_sequence(model, diffuse_texture, camera, "gif");
-
-    Framebuffer framebuffer{};
-    PhongShader shader(model, camera, kLight, &diffuse_texture);
-    render_model(model, framebuffer, shader);
-
-    framebuffer.color.flip_vertically();
-    framebuffer.color.write_tga_file(kColorBufferTga.c_str());
-    dump_depth_buffer(framebuffer.depth, kDepthBufferTga.c_str());
-
-    convert_tga_to_png(kColorBufferTga.c_str(), kColorBufferPng.c_str());
-    convert_tga_to_png(kDepthBufferTga.c_str(), kDepthBufferPng.c_str());
-    return 0;
+    // Bad options and unreadable assets end here instead of in std::terminate.
+    try
+    {
+        const RenderSettings settings = parse_settings(argc, argv);
+        if (settings.timings)
+        {
+            trace::enable();
+            trace::set_thread_name("main");
+        }
+        if (!settings.benchmark_path.empty())
+        {
+            return run_benchmark(settings);
+        }
+
+        const bool default_model = settings.model_path.empty();
+        const Model model(default_model ? kModelPath : settings.model_path);
+        std::optional<Texture> diffuse_texture;
+        std::optional<MaterialSet> materials;
+        if (default_model)
+        {
+            diffuse_texture.emplace(kDiffuseTexturePath);
+        }
+        else
+        {
+            materials.emplace(model.materials());
+        }
+        const Camera camera = default_model ? default_camera(kWidth, kHeight) : framing_camera(model, kWidth, kHeight);
+        const Texture* texture = diffuse_texture ? &*diffuse_texture : nullptr;
+
+        render_rotation_sequence(model, texture, materials ? &*materials : nullptr, camera, "gif", settings);
+
+        Framebuffer framebuffer(kWidth, kHeight);
+        PassBuffers pass_buffers(settings.mode, kWidth, kHeight);
+        pass_buffers.begin_frame(model, camera);
+
+        RenderStats stats;
+        std::optional<OverdrawMap> overdraw;
+        if (settings.overdraw)
+        {
+            overdraw.emplace(kWidth, kHeight);
+            stats.overdraw = &*overdraw;
+        }
+        std::optional<RenderStats::Scope> stats_scope;
+
+        if (materials)
+        {
+            // A headlight, as in the turntable.
+            const Light light(camera.get_target() - camera.get_position(), kLight.get_color(), kLight.get_intensity());
+            MaterialShader shader(model, camera, light, *materials);
+            if (settings.stats)
+            {
+                stats_scope.emplace(stats);
+            }
+            draw(model, framebuffer, pass_buffers, shader);
+        }
+        else
+        {
+            const std::vector<Light> lights = scene_lights(camera, settings.point_lights);
+            LightGrid light_grid(kWidth, kHeight);
+            light_grid.build(lights, camera);
+            if (settings.point_lights > 0)
+            {
+                std::cout << "# light grid: " << light_grid.total_entries() << " entries for " << lights.size()
+                    << " lights over " << light_grid.tiles_x() * light_grid.tiles_y() << " tiles" << std::endl;
+            }
+
+            PhongShader shader(model, camera, lights, &light_grid, texture, 0.1f, 0.5f, 32.0f, settings.precision);
+            ShadowMap shadow_map(kShadowMapSize, settings.shadow_pcf_radius);
+            if (settings.shadows)
+            {
+                const auto shadow_start = std::chrono::steady_clock::now();
+                shadow_map.render(model, lights[0]);
+                const std::chrono::duration<double, std::milli> shadow_time =
+                    std::chrono::steady_clock::now() - shadow_start;
+                std::cout << "# shadow pass: " << shadow_time.count() << " ms" << std::endl;
+                shader.set_shadow_map(&shadow_map);
+            }
+
+            const auto color_start = std::chrono::steady_clock::now();
+            if (settings.stats)
+            {
+                stats_scope.emplace(stats);
+            }
+            draw(model, framebuffer, pass_buffers, shader);
+            if (settings.shadows)
+            {
+                const std::chrono::duration<double, std::milli> color_time =
+                    std::chrono::steady_clock::now() - color_start;
+                std::cout << "# colour pass: " << color_time.count() << " ms" << std::endl;
+            }
+            if (settings.precision == ShadingPrecision::Fast)
+            {
+                std::cout << "# fast-math specular error bound: " << shader.specular_error_bound() << std::endl;
+            }
+        }
+
+        stats_scope.reset();
+        if (settings.stats)
+        {
+            print_stats(stats, overdraw ? &*overdraw : nullptr);
+        }
+        if (overdraw)
+        {
+            TGAImage heatmap;
+            overdraw->to_heatmap(heatmap);
+            image_io::write_image(heatmap, kOverdrawPng, true);
+            overdraw->write_tile_totals_csv(kOverdrawTilesCsv);
+        }
+
+        const TGAImage& color_image = framebuffer.resolve();
+        image_io::write_image(color_image, kColorBufferTga, true);
+        image_io::write_image(color_image, kColorBufferPng, true);
+
+        constexpr float depth_clear = std::numeric_limits<float>::lowest();
+        std::vector<float> depth_values;
+        framebuffer.depth.resolve(depth_values);
+        TGAImage depth_image;
+        depth_export::to_image(depth_values.data(), kWidth, kHeight, depth_clear, depth_image);
+        image_io::write_image(depth_image, kDepthBufferTga, true);
+        image_io::write_image(depth_image, kDepthBufferPng, true);
+        if (settings.depth16)
+        {
+            depth_export::write_pgm16(depth_values.data(), kWidth, kHeight, depth_clear, kDepthBufferPgm16, true);
+        }
+
+        if (settings.timings)
+        {
+            trace::print_summary(std::cout);
+        }
+        if (!settings.trace_path.empty())
+        {
+            trace::write_chrome_json(settings.trace_path);
+        }
+        return 0;
+    }
+    catch (const std::exception& error)
+    {
+        std::cerr << error.what() << '\n' << kUsage;
+        return 2;
+    }
 }
@@ -0,0 +1,213 @@
+#include "material.h"
+
+#include "fast_math.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+    float wrap_coord(float value)
+    {
+        float wrapped = std::fmod(value, 1.0f);
+        if (wrapped < 0.0f)
+        {
+            wrapped += 1.0f;
+        }
+        return wrapped;
+    }
+
+    unsigned char to_byte(float value)
+    {
+        return static_cast<unsigned char>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+
+    std::unique_ptr<Texture> load_optional_texture(const String& path, const TextureOptions& options)
+    {
+        if (path.empty())
+        {
+            return nullptr;
+        }
+        if (!std::filesystem::exists(path))
+        {
+            std::cerr << "missing material texture " << path << "\n";
+            return nullptr;
+        }
+        return std::make_unique<Texture>(path, options);
+    }
+
+    String read_map_path(std::istringstream& iss, const std::filesystem::path& directory)
+    {
+        String file;
+        String token;
+        // Map statements may carry options such as "-bm 1.0"; the file name comes last.
+        while (iss >> token)
+        {
+            file = token;
+        }
+        return file.empty() ? file : (directory / file).string();
+    }
+}
+
+std::vector<Material> load_material_library(const String& path)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        throw std::runtime_error("Failed to open material library: " + path);
+    }
+
+    const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    std::vector<Material> materials;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream iss(line);
+        String keyword;
+        if (!(iss >> keyword))
+        {
+            continue;
+        }
+
+        if (keyword == "newmtl")
+        {
+            materials.emplace_back();
+            iss >> materials.back().name;
+            continue;
+        }
+        if (materials.empty())
+        {
+            continue;
+        }
+
+        Material& material = materials.back();
+        if (keyword == "Kd")
+        {
+            iss >> material.diffuse_color.x >> material.diffuse_color.y >> material.diffuse_color.z;
+        }
+        else if (keyword == "Pm")
+        {
+            iss >> material.metalness;
+        }
+        else if (keyword == "Pr")
+        {
+            iss >> material.roughness;
+        }
+        else if (keyword == "map_Kd")
+        {
+            material.diffuse_map = read_map_path(iss, directory);
+        }
+        else if (keyword == "norm" || keyword == "map_Bump" || keyword == "bump")
+        {
+            material.normal_map = read_map_path(iss, directory);
+        }
+        else if (keyword == "map_Pm")
+        {
+            material.metalness_map = read_map_path(iss, directory);
+        }
+        else if (keyword == "map_Pr")
+        {
+            material.roughness_map = read_map_path(iss, directory);
+        }
+    }
+
+    return materials;
+}
+
+SurfaceMap::SurfaceMap(int width, int height)
+    : width_(width),
+      height_(height),
+      texels_(static_cast<size_t>(width) * height * 4)
+{
+}
+
+std::unique_ptr<SurfaceMap> SurfaceMap::build(const Material& material, const TextureOptions& options)
+{
+    const std::unique_ptr<Texture> normal = load_optional_texture(material.normal_map, options);
+    const std::unique_ptr<Texture> metalness = load_optional_texture(material.metalness_map, options);
+    // A single map bound to both slots follows the glTF convention:
+    // roughness in green, metalness in blue.
+    const bool packed_orm = !material.metalness_map.empty() && material.metalness_map == material.roughness_map;
+    const std::unique_ptr<Texture> roughness = packed_orm
+                                                   ? nullptr
+                                                   : load_optional_texture(material.roughness_map, options);
+
+    int width = 0;
+    int height = 0;
+    for (const Texture* texture : {normal.get(), metalness.get(), roughness.get()})
+    {
+        if (texture && texture->is_valid())
+        {
+            width = std::max(width, texture->width());
+            height = std::max(height, texture->height());
+        }
+    }
+    if (width == 0 || height == 0)
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<SurfaceMap> map(new SurfaceMap(width, height));
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            const Vec2f uv((static_cast<float>(x) + 0.5f) / static_cast<float>(width),
+                           1.0f - (static_cast<float>(y) + 0.5f) / static_cast<float>(height));
+
+            const Vec3f n = normal ? normal->sample(uv) : Vec3f(0.5f, 0.5f, 1.0f);
+            // Slots without a map hold 1, so the shader applies Pm/Pr once.
+            float metal = 1.0f;
+            float rough = 1.0f;
+            if (metalness)
+            {
+                const Vec3f m = metalness->sample(uv);
+                metal = packed_orm ? m.z : m.x;
+                rough = packed_orm ? m.y : rough;
+            }
+            if (roughness)
+            {
+                rough = roughness->sample(uv).x;
+            }
+
+            unsigned char* texel = map->texels_.data() + (x + y * width) * 4;
+            texel[0] = to_byte(n.x);
+            texel[1] = to_byte(n.y);
+            texel[2] = to_byte(metal);
+            texel[3] = to_byte(rough);
+        }
+    }
+    return map;
+}
+
+SurfaceSample SurfaceMap::sample(const Vec2f& uv) const
+{
+    const float u = wrap_coord(uv.x);
+    const float v = wrap_coord(uv.y);
+
+    const int x = std::clamp(static_cast<int>(u * width_), 0, width_ - 1);
+    const int y = std::clamp(static_cast<int>((1.0f - v) * height_), 0, height_ - 1);
+    const unsigned char* texel = texels_.data() + (x + y * width_) * 4;
+
+    const float nx = texel[0] / 127.5f - 1.0f;
+    const float ny = texel[1] / 127.5f - 1.0f;
+    const float nz = std::sqrt(std::max(0.0f, 1.0f - nx * nx - ny * ny));
+    return {Vec3f(nx, ny, nz), fast_math::kByteToFloat[texel[2]], fast_math::kByteToFloat[texel[3]]};
+}
+
+MaterialSet::MaterialSet(const std::vector<Material>& materials, const TextureOptions& options)
+{
+    textures_.reserve(materials.size());
+    for (const Material& material : materials)
+    {
+        MaterialTextures entry;
+        entry.diffuse = load_optional_texture(material.diffuse_map, options);
+        entry.surface = SurfaceMap::build(material, options);
+        textures_.push_back(std::move(entry));
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "geometry.h"
+#include "texture.h"
+
+struct Material
+{
+    String name;
+    Vec3f diffuse_color{1.0f, 1.0f, 1.0f};
+    float metalness = 0.0f;
+    float roughness = 1.0f;
+
+    String diffuse_map;
+    String normal_map;
+    String metalness_map;
+    String roughness_map;
+};
+
+// Parses a Wavefront MTL file. Map paths are resolved relative to the file.
+std::vector<Material> load_material_library(const String& path);
+
+struct SurfaceSample
+{
+    Vec3f normal;
+    float metalness;
+    float roughness;
+};
+
+// Tangent-space normal, metalness and roughness interleaved into one RGBA8
+// texel (normal.xy, metalness, roughness) so a fragment needs a single fetch.
+// Metalness and roughness are factors on the material's Pm/Pr.
+class SurfaceMap
+{
+public:
+    static std::unique_ptr<SurfaceMap> build(const Material& material, const TextureOptions& options);
+
+    [[nodiscard]] SurfaceSample sample(const Vec2f& uv) const;
+
+private:
+    SurfaceMap(int width, int height);
+
+    int width_;
+    int height_;
+    std::vector<unsigned char> texels_;
+};
+
+struct MaterialTextures
+{
+    std::unique_ptr<Texture> diffuse;
+    std::unique_ptr<SurfaceMap> surface;
+};
+
+// Textures for every material of a model, indexed like Model::materials().
+class MaterialSet
+{
+public:
+    MaterialSet(const std::vector<Material>& materials, const TextureOptions& options = {});
+
+    [[nodiscard]] size_t size() const { return textures_.size(); }
+    [[nodiscard]] const MaterialTextures& textures(int material_index) const { return textures_.at(material_index); }
+
+private:
+    std::vector<MaterialTextures> textures_;
+};
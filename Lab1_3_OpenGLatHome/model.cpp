@@ -1,3 +1,5 @@
+#include <cmath>
+#include <filesystem>
 #include <iostream>
 #include <string>
 #include <fstream>
@@ -5,6 +7,7 @@
 #include <vector>
 #include <stdexcept>
 #include "model.h"
+#include "trace.h"
 
 void Model::parse_face(std::istringstream& iss)
 {
@@ -55,6 +58,45 @@ void Model::parse_face(std::istringstream& iss)
     {
         faces_.push_back(face);
         texcoord_indices_.push_back(uv_indices);
+        face_materials_.push_back(current_material_);
+    }
+}
+
+void Model::parse_material_library(std::istringstream& iss)
+{
+    String keyword;
+    String file;
+    iss >> keyword >> file;
+    if (file.empty())
+    {
+        return;
+    }
+
+    const String path = (std::filesystem::path(directory_) / file).string();
+    if (!std::filesystem::exists(path))
+    {
+        std::cerr << "missing material library " << path << "\n";
+        return;
+    }
+
+    std::vector<Material> library = load_material_library(path);
+    materials_.insert(materials_.end(), library.begin(), library.end());
+}
+
+void Model::parse_use_material(std::istringstream& iss)
+{
+    String keyword;
+    String name;
+    iss >> keyword >> name;
+
+    current_material_ = -1;
+    for (size_t i = 0; i < materials_.size(); ++i)
+    {
+        if (materials_[i].name == name)
+        {
+            current_material_ = static_cast<int>(i);
+            break;
+        }
     }
 }
 
@@ -110,6 +152,14 @@ void Model::parse_file(std::ifstream& in)
         {
             parse_face(iss);
         }
+        else if (line.rfind("mtllib ", 0) == 0)
+        {
+            parse_material_library(iss);
+        }
+        else if (line.rfind("usemtl ", 0) == 0)
+        {
+            parse_use_material(iss);
+        }
     }
 
     std::cout << "# v: " << verts_.size() << "   f: " << faces_.size() << std::endl;
@@ -117,14 +167,17 @@ void Model::parse_file(std::ifstream& in)
 
 Model::Model(const String& filename)
 {
+    const trace::Scope scope("load model");
     std::ifstream in(filename);
     if (!in)
     {
         throw std::runtime_error("Failed to open model file: " + filename);
     }
 
+    directory_ = std::filesystem::path(filename).parent_path().string();
     parse_file(in);
     compute_vertex_normals();
+    compute_vertex_tangents();
 }
 
 Model::~Model() = default;
@@ -176,6 +229,78 @@ void Model::compute_vertex_normals()
     }
 }
 
+void Model::compute_vertex_tangents()
+{
+    std::vector<Vec3f> tangents(verts_.size(), Vec3f(0.0f, 0.0f, 0.0f));
+    std::vector<Vec3f> bitangents(verts_.size(), Vec3f(0.0f, 0.0f, 0.0f));
+
+    for (size_t face_index = 0; face_index < faces_.size(); ++face_index)
+    {
+        const std::vector<int>& face = faces_[face_index];
+        if (face.size() < 3)
+        {
+            continue;
+        }
+
+        const Vec3f edge0 = verts_.at(face[1]) - verts_.at(face[0]);
+        const Vec3f edge1 = verts_.at(face[2]) - verts_.at(face[0]);
+        const Vec2f uv0 = texcoord(static_cast<int>(face_index), 0);
+        const Vec2f duv0 = texcoord(static_cast<int>(face_index), 1) - uv0;
+        const Vec2f duv1 = texcoord(static_cast<int>(face_index), 2) - uv0;
+
+        const float det = duv0.x * duv1.y - duv1.x * duv0.y;
+        if (std::abs(det) < 1e-12f)
+        {
+            continue;
+        }
+
+        const float r = 1.0f / det;
+        const Vec3f tangent = (edge0 * duv1.y - edge1 * duv0.y) * r;
+        const Vec3f bitangent = (edge1 * duv0.x - edge0 * duv1.x) * r;
+        for (int vertex_idx : face)
+        {
+            if (vertex_idx >= 0 && vertex_idx < static_cast<int>(tangents.size()))
+            {
+                tangents[vertex_idx] += tangent;
+                bitangents[vertex_idx] += bitangent;
+            }
+        }
+    }
+
+    vertex_tangents_.resize(verts_.size());
+    for (size_t i = 0; i < verts_.size(); ++i)
+    {
+        const Vec3f& n = vertex_normals_[i];
+        Vec3f t = tangents[i] - n * n.dot(tangents[i]);
+        if (t.length() < 1e-6f)
+        {
+            // No usable UV gradient: pick any direction perpendicular to the normal.
+            t = (std::abs(n.x) < 0.9f ? Vec3f(1.0f, 0.0f, 0.0f) : Vec3f(0.0f, 1.0f, 0.0f)).cross(n);
+        }
+        t = t.normalized();
+        const float handedness = (n.cross(t).dot(bitangents[i]) < 0.0f) ? -1.0f : 1.0f;
+        vertex_tangents_[i] = Vec4f(t, handedness);
+    }
+}
+
+Vec4f Model::tangent(int vertex_index) const
+{
+    if (vertex_index < 0 || vertex_index >= static_cast<int>(vertex_tangents_.size()))
+    {
+        return {1.0f, 0.0f, 0.0f, 1.0f};
+    }
+    return vertex_tangents_[vertex_index];
+}
+
+int Model::face_material(int face_index) const
+{
+    if (face_index < 0 || face_index >= static_cast<int>(face_materials_.size()))
+    {
+        return -1;
+    }
+    return face_materials_[face_index];
+}
+
 Vec3f Model::normal(int vertex_index) const
 {
     if (vertex_index < 0 || vertex_index >= static_cast<int>(vertex_normals_.size()))
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include "geometry.h"
+#include "material.h"
 
 class Model
 {
@@ -12,10 +13,17 @@ private:
     std::vector<Vec2f> texcoords_;
     std::vector<std::vector<int>> texcoord_indices_;
 
+    String directory_;
+    std::vector<Material> materials_;
+    std::vector<int> face_materials_;
+    int current_material_ = -1;
+
 public:
     void parse_face(std::istringstream& iss);
     void parse_vertex(std::istringstream& iss);
     void parse_texcoord(std::istringstream& iss);
+    void parse_material_library(std::istringstream& iss);
+    void parse_use_material(std::istringstream& iss);
     void parse_file(std::ifstream& in);
     explicit Model(const String& filename);
     ~Model();
@@ -26,8 +34,15 @@ public:
     [[nodiscard]] Vec2f texcoord(int face_index, int vertex_index) const;
     [[nodiscard]] bool has_texcoords() const { return !texcoords_.empty(); }
     [[nodiscard]] Vec3f normal(int vertex_index) const;
+    // xyz is the tangent along +u, w the handedness of the bitangent.
+    [[nodiscard]] Vec4f tangent(int vertex_index) const;
+
+    [[nodiscard]] const std::vector<Material>& materials() const { return materials_; }
+    [[nodiscard]] int face_material(int face_index) const;
 
 private:
     void compute_vertex_normals();
+    void compute_vertex_tangents();
     std::vector<Vec3f> vertex_normals_;
+    std::vector<Vec4f> vertex_tangents_;
 };
@@ -0,0 +1,146 @@
+#include "render_stats.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+    thread_local RenderStats* current_stats = nullptr;
+
+    struct ColorStop
+    {
+        float position;
+        float r;
+        float g;
+        float b;
+    };
+
+    constexpr std::array<ColorStop, 4> kHeatmap{{
+        {0.0f, 0.0f, 0.0f, 1.0f},
+        {1.0f / 3.0f, 0.0f, 1.0f, 0.0f},
+        {2.0f / 3.0f, 1.0f, 1.0f, 0.0f},
+        {1.0f, 1.0f, 0.0f, 0.0f},
+    }};
+}
+
+OverdrawMap::OverdrawMap(int width, int height)
+    : width_(width),
+      height_(height),
+      counts_(static_cast<size_t>(width) * height, 0)
+{
+}
+
+void OverdrawMap::clear()
+{
+    std::fill(counts_.begin(), counts_.end(), 0u);
+}
+
+uint32_t OverdrawMap::max_count() const
+{
+    return counts_.empty() ? 0 : *std::max_element(counts_.begin(), counts_.end());
+}
+
+uint64_t OverdrawMap::tile_total(int tile_x, int tile_y) const
+{
+    uint64_t total = 0;
+    for (int y = tile_y * kTileSize; y < std::min((tile_y + 1) * kTileSize, height_); ++y)
+    {
+        for (int x = tile_x * kTileSize; x < std::min((tile_x + 1) * kTileSize, width_); ++x)
+        {
+            total += at(x, y);
+        }
+    }
+    return total;
+}
+
+void OverdrawMap::to_heatmap(TGAImage& out) const
+{
+    if (out.get_width() != width_ || out.get_height() != height_ || out.get_bytespp() != TGAImage::RGB)
+    {
+        out = TGAImage(width_, height_, TGAImage::RGB);
+    }
+
+    // One colour per count, so the ramp is evaluated max_count() times.
+    const uint32_t scale = std::max(max_count(), 4u);
+    std::vector<std::array<unsigned char, 3>> palette(scale + 1);
+    palette[0] = {0, 0, 0};
+    for (uint32_t count = 1; count <= scale; ++count)
+    {
+        const float t = static_cast<float>(count - 1) / static_cast<float>(scale - 1);
+        size_t stop = 1;
+        while (stop + 1 < kHeatmap.size() && kHeatmap[stop].position < t)
+        {
+            ++stop;
+        }
+        const ColorStop& a = kHeatmap[stop - 1];
+        const ColorStop& b = kHeatmap[stop];
+        const float f = std::clamp((t - a.position) / (b.position - a.position), 0.0f, 1.0f);
+        const auto channel = [f](float from, float to)
+        {
+            return static_cast<unsigned char>((from + (to - from) * f) * 255.0f + 0.5f);
+        };
+        // BGR, like TGAImage.
+        palette[count] = {channel(a.b, b.b), channel(a.g, b.g), channel(a.r, b.r)};
+    }
+
+    unsigned char* dst = out.buffer();
+    for (const uint32_t count : counts_)
+    {
+        const std::array<unsigned char, 3>& color = palette[std::min(count, scale)];
+        dst[0] = color[0];
+        dst[1] = color[1];
+        dst[2] = color[2];
+        dst += 3;
+    }
+}
+
+void OverdrawMap::write_tile_totals_csv(const String& path) const
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+    {
+        throw std::runtime_error("Failed to open overdraw tile file: " + path);
+    }
+
+    out << "tile_x,tile_y,fragments\n";
+    for (int tile_y = 0; tile_y < tiles_y(); ++tile_y)
+    {
+        for (int tile_x = 0; tile_x < tiles_x(); ++tile_x)
+        {
+            out << tile_x << ',' << tile_y << ',' << tile_total(tile_x, tile_y) << '\n';
+        }
+    }
+
+    if (!out)
+    {
+        throw std::runtime_error("Failed to write overdraw tile file: " + path);
+    }
+}
+
+void RenderStats::merge(const RenderStats& other)
+{
+    triangles_submitted += other.triangles_submitted;
+    triangles_culled += other.triangles_culled;
+    triangles_rasterized += other.triangles_rasterized;
+    pixels_tested += other.pixels_tested;
+    pixels_passed += other.pixels_passed;
+    pixels_shaded += other.pixels_shaded;
+}
+
+RenderStats::Scope::Scope(RenderStats& stats)
+    : previous_(current_stats)
+{
+    current_stats = &stats;
+}
+
+RenderStats::Scope::~Scope()
+{
+    current_stats = previous_;
+}
+
+RenderStats* RenderStats::current()
+{
+    return current_stats;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "geometry.h"
+#include "libs/tgaimage.h"
+
+// Fragments shaded per pixel, for overdraw heatmaps and per-tile totals.
+// Bands rendered on different threads touch disjoint rows, so they can
+// share one map.
+class OverdrawMap
+{
+public:
+    static constexpr int kTileSize = 16;
+
+    OverdrawMap(int width, int height);
+
+    void clear();
+    void add(int x, int y) { ++counts_[static_cast<size_t>(y) * width_ + x]; }
+
+    [[nodiscard]] int width() const { return width_; }
+    [[nodiscard]] int height() const { return height_; }
+    [[nodiscard]] uint32_t at(int x, int y) const { return counts_[static_cast<size_t>(y) * width_ + x]; }
+    [[nodiscard]] uint32_t max_count() const;
+    // Fragments shaded inside tile (tile_x, tile_y).
+    [[nodiscard]] uint64_t tile_total(int tile_x, int tile_y) const;
+    [[nodiscard]] int tiles_x() const { return (width_ + kTileSize - 1) / kTileSize; }
+    [[nodiscard]] int tiles_y() const { return (height_ + kTileSize - 1) / kTileSize; }
+
+    // Black for untouched pixels, then blue through green and yellow to red
+    // at max(max_count(), 4) fragments.
+    void to_heatmap(TGAImage& out) const;
+
+    // "tile_x,tile_y,fragments", one row per tile, in framebuffer coordinates
+    // (tile_y 0 is the bottom row). Throws std::runtime_error when the file
+    // cannot be written.
+    void write_tile_totals_csv(const String& path) const;
+
+private:
+    int width_;
+    int height_;
+    std::vector<uint32_t> counts_;
+};
+
+// Rasterizer counters. Collected for the calling thread while a
+// RenderStats::Scope is alive; without one the rasterizer skips them.
+struct RenderStats
+{
+    // Every triangle handed to the rasterizer (once per band when a frame is
+    // split into bands).
+    uint64_t triangles_submitted = 0;
+    // Degenerate, or outside the screen or band.
+    uint64_t triangles_culled = 0;
+    uint64_t triangles_rasterized = 0;
+    // Covered pixels that reached the depth test, those that passed it, and
+    // lighting evaluations (fragment() or a deferred shade()).
+    uint64_t pixels_tested = 0;
+    uint64_t pixels_passed = 0;
+    uint64_t pixels_shaded = 0;
+
+    // Optional; receives one count per lighting evaluation.
+    OverdrawMap* overdraw = nullptr;
+
+    void merge(const RenderStats& other);
+
+    class Scope
+    {
+    public:
+        explicit Scope(RenderStats& stats);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        RenderStats* previous_;
+    };
+
+    // The calling thread's active stats, or nullptr.
+    static RenderStats* current();
+};
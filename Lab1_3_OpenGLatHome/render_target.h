@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "fast_math.h"
+#include "geometry.h"
+#include "libs/tgaimage.h"
+
+enum class PixelFormat
+{
+    RGBA8,
+    // 10 bits per colour channel, 2-bit alpha.
+    RGB10A2
+};
+
+// Colour buffer with a compile-time pixel format: every pixel is one 32-bit
+// word and rows start on 64-byte boundaries, so a store is a single aligned
+// write and spans can be filled four pixels at a time. Like DepthBuffer it
+// keeps a cleared flag per 8x8 tile: clear() only sets the flags, a tile is
+// filled on its first write, and export emits the clear colour for untouched
+// tiles without reading them. Converted to a TGAImage only for export.
+template <PixelFormat Format>
+class RenderTarget
+{
+public:
+    static constexpr PixelFormat kFormat = Format;
+    static constexpr size_t kRowAlignment = 64;
+    static constexpr int kTileSize = 8;
+
+    RenderTarget(int width, int height)
+        : width_(width),
+          height_(height),
+          pitch_(static_cast<int>((width * sizeof(uint32_t) + kRowAlignment - 1) / kRowAlignment *
+                                  kRowAlignment / sizeof(uint32_t))),
+          tiles_x_((width + kTileSize - 1) / kTileSize),
+          tiles_y_((height + kTileSize - 1) / kTileSize),
+          pixels_(static_cast<uint32_t*>(::operator new(static_cast<size_t>(pitch_) * height * sizeof(uint32_t),
+                                                        std::align_val_t{kRowAlignment}))),
+          cleared_(static_cast<size_t>(tiles_x_) * tiles_y_, 1)
+    {
+    }
+
+    [[nodiscard]] int width() const { return width_; }
+    [[nodiscard]] int height() const { return height_; }
+    // Row stride in pixels.
+    [[nodiscard]] int pitch() const { return pitch_; }
+
+    static uint32_t pack(const Vec3f& color)
+    {
+        if constexpr (Format == PixelFormat::RGBA8)
+        {
+            return fast_math::pack_rgba8(color);
+        }
+        else
+        {
+            return fast_math::pack_rgb10a2(color);
+        }
+    }
+
+    [[nodiscard]] uint32_t clear_pixel() const { return clear_pixel_; }
+    [[nodiscard]] bool tile_cleared(int tile_x, int tile_y) const
+    {
+        return cleared_[static_cast<size_t>(tile_y) * tiles_x_ + tile_x] != 0;
+    }
+
+    void store(int x, int y, uint32_t pixel)
+    {
+        touch_tile(x / kTileSize, y / kTileSize);
+        row(y)[x] = pixel;
+    }
+
+    void fill_span(int x0, int x1, int y, uint32_t pixel)
+    {
+        for (int tile_x = x0 / kTileSize; tile_x <= x1 / kTileSize; ++tile_x)
+        {
+            touch_tile(tile_x, y / kTileSize);
+        }
+        fill(row(y) + x0, row(y) + x1 + 1, pixel);
+    }
+
+    // O(tiles): pixels are only written when a tile is first touched.
+    void clear(uint32_t pixel = 0)
+    {
+        clear_pixel_ = pixel;
+        std::fill(cleared_.begin(), cleared_.end(), uint8_t{1});
+    }
+
+    // Writes BGR bytes into `out`, which is (re)allocated only when its size or
+    // format differs.
+    void export_image(TGAImage& out) const
+    {
+        if (out.get_width() != width_ || out.get_height() != height_ || out.get_bytespp() != TGAImage::RGB)
+        {
+            out = TGAImage(width_, height_, TGAImage::RGB);
+        }
+
+        unsigned char clear_bgr[3];
+        to_bgr(clear_pixel_, clear_bgr);
+        for (int y = 0; y < height_; ++y)
+        {
+            const uint32_t* src = row(y);
+            unsigned char* dst = out.buffer() + static_cast<size_t>(y) * width_ * 3;
+            for (int tile_x = 0; tile_x < tiles_x_; ++tile_x)
+            {
+                const int x0 = tile_x * kTileSize;
+                const int x1 = std::min(x0 + kTileSize, width_);
+                if (tile_cleared(tile_x, y / kTileSize))
+                {
+                    for (int x = x0; x < x1; ++x)
+                    {
+                        std::copy(clear_bgr, clear_bgr + 3, dst + x * 3);
+                    }
+                    continue;
+                }
+                for (int x = x0; x < x1; ++x)
+                {
+                    to_bgr(src[x], dst + x * 3);
+                }
+            }
+        }
+    }
+
+private:
+    [[nodiscard]] uint32_t* row(int y) { return pixels_.get() + static_cast<size_t>(y) * pitch_; }
+    [[nodiscard]] const uint32_t* row(int y) const { return pixels_.get() + static_cast<size_t>(y) * pitch_; }
+
+    void touch_tile(int tile_x, int tile_y)
+    {
+        uint8_t& cleared = cleared_[static_cast<size_t>(tile_y) * tiles_x_ + tile_x];
+        if (!cleared)
+        {
+            return;
+        }
+        cleared = 0;
+        const int x0 = tile_x * kTileSize;
+        const int x1 = std::min(x0 + kTileSize, width_);
+        for (int y = tile_y * kTileSize; y < std::min((tile_y + 1) * kTileSize, height_); ++y)
+        {
+            fill(row(y) + x0, row(y) + x1, clear_pixel_);
+        }
+    }
+
+    static void to_bgr(uint32_t pixel, unsigned char* bgr)
+    {
+        if constexpr (Format == PixelFormat::RGBA8)
+        {
+            bgr[0] = static_cast<unsigned char>(pixel >> 16);
+            bgr[1] = static_cast<unsigned char>(pixel >> 8);
+            bgr[2] = static_cast<unsigned char>(pixel);
+        }
+        else
+        {
+            bgr[0] = static_cast<unsigned char>(pixel >> 22);
+            bgr[1] = static_cast<unsigned char>(pixel >> 12);
+            bgr[2] = static_cast<unsigned char>(pixel >> 2);
+        }
+    }
+
+    struct AlignedDelete
+    {
+        void operator()(uint32_t* pixels) const { ::operator delete(pixels, std::align_val_t{kRowAlignment}); }
+    };
+
+    static void fill(uint32_t* begin, uint32_t* end, uint32_t pixel)
+    {
+#ifdef FAST_MATH_SSE2
+        const __m128i value = _mm_set1_epi32(static_cast<int>(pixel));
+        for (; begin < end && (reinterpret_cast<uintptr_t>(begin) & 15) != 0; ++begin)
+        {
+            *begin = pixel;
+        }
+        for (; end - begin >= 8; begin += 8)
+        {
+            _mm_store_si128(reinterpret_cast<__m128i*>(begin), value);
+            _mm_store_si128(reinterpret_cast<__m128i*>(begin + 4), value);
+        }
+#endif
+        std::fill(begin, end, pixel);
+    }
+
+    int width_;
+    int height_;
+    int pitch_;
+    int tiles_x_;
+    int tiles_y_;
+    std::unique_ptr<uint32_t[], AlignedDelete> pixels_;
+    std::vector<uint8_t> cleared_;
+    uint32_t clear_pixel_ = 0;
+};
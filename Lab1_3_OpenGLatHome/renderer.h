@@ -3,14 +3,26 @@
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstdint>
+#include <limits>
 #include <vector>
 
+#include "gbuffer.h"
 #include "geometry.h"
 #include "libs/tgaimage.h"
+#include "render_stats.h"
 #include "shader.h"
+#include "visibility_buffer.h"
 
 namespace renderer
 {
+    // Half-open range of framebuffer rows a rasterizer call may touch.
+    struct RowRange
+    {
+        int begin = 0;
+        int end = std::numeric_limits<int>::max();
+    };
+
     inline void line(int x0, int y0, int x1, int y1, TGAImage& image, const TGAColor& color)
     {
         bool steep = false;
@@ -109,74 +121,464 @@ namespace renderer
         }
     }
 
-    inline void barycentric_triangle(const std::array<Vec3f, 3>& screen_vertices,
-                                     TGAImage& image,
-                                     std::vector<float>& zbuffer,
-                                     IShader& shader)
+    enum class DepthTest
+    {
+        // Keep nearer fragments and write their depth.
+        Greater,
+        // Keep fragments exactly at the stored depth, without writing it:
+        // after a depth pre-pass each pixel is shaded once.
+        Equal
+    };
+
+    namespace detail
     {
-        const int width = image.get_width();
-        const int height = image.get_height();
-
-        const int min_x = std::clamp(static_cast<int>(std::floor(std::min({
-                                         screen_vertices[0].x, screen_vertices[1].x, screen_vertices[2].x
-                                     }))), 0, width - 1);
-        const int max_x = std::clamp(static_cast<int>(std::ceil(std::max({
-                                         screen_vertices[0].x, screen_vertices[1].x, screen_vertices[2].x
-                                     }))), 0, width - 1);
-        const int min_y = std::clamp(static_cast<int>(std::floor(std::min({
-                                         screen_vertices[0].y, screen_vertices[1].y, screen_vertices[2].y
-                                     }))), 0, height - 1);
-        const int max_y = std::clamp(static_cast<int>(std::ceil(std::max({
-                                         screen_vertices[0].y, screen_vertices[1].y, screen_vertices[2].y
-                                     }))), 0, height - 1);
-
-        const Vec2f v0(screen_vertices[1].x - screen_vertices[0].x,
-                       screen_vertices[1].y - screen_vertices[0].y);
-        const Vec2f v1(screen_vertices[2].x - screen_vertices[0].x,
-                       screen_vertices[2].y - screen_vertices[0].y);
-
-        const float dot00 = v0.x * v0.x + v0.y * v0.y;
-        const float dot01 = v0.x * v1.x + v0.y * v1.y;
-        const float dot11 = v1.x * v1.x + v1.y * v1.y;
-        const float denom = dot00 * dot11 - dot01 * dot01;
-
-        if (std::abs(denom) < 1e-6f)
+        // Per-triangle pixel tallies, added to the thread's RenderStats (if
+        // any) when the triangle is done.
+        class PixelCounts
         {
-            return;
-        }
+        public:
+            PixelCounts()
+                : stats_(RenderStats::current()),
+                  overdraw_(stats_ ? stats_->overdraw : nullptr)
+            {
+            }
+
+            ~PixelCounts()
+            {
+                if (stats_)
+                {
+                    stats_->pixels_passed += passed_;
+                    stats_->pixels_shaded += shaded_;
+                }
+            }
+
+            PixelCounts(const PixelCounts&) = delete;
+            PixelCounts& operator=(const PixelCounts&) = delete;
 
-        const float inv_denom = 1.0f / denom;
+            void passed() { ++passed_; }
 
-        for (int y = min_y; y <= max_y; ++y)
+            void shaded(int x, int y)
+            {
+                ++shaded_;
+                if (overdraw_)
+                {
+                    overdraw_->add(x, y);
+                }
+            }
+
+        private:
+            RenderStats* stats_;
+            OverdrawMap* overdraw_;
+            uint64_t passed_ = 0;
+            uint64_t shaded_ = 0;
+        };
+
+        // Walks the covered pixels of a triangle inside `rows` and calls
+        // pixel(x, y, w, u, v, z) with the screen-space barycentrics (w for
+        // vertex 0, u for 1, v for 2) and the interpolated depth, then
+        // span_end(y) after each row. Every interpolant is affine along a
+        // span, so each step is two additions.
+        template <typename PixelFn, typename SpanEndFn>
+        void rasterize(const std::array<Vec4f, 3>& screen_vertices,
+                       int width,
+                       int height,
+                       const RowRange& rows,
+                       PixelFn&& pixel,
+                       SpanEndFn&& span_end)
         {
-            for (int x = min_x; x <= max_x; ++x)
+            RenderStats* const stats = RenderStats::current();
+            if (stats)
             {
-                const Vec2f v2(static_cast<float>(x) - screen_vertices[0].x,
+                ++stats->triangles_submitted;
+            }
+
+            const int min_x = std::clamp(static_cast<int>(std::floor(std::min({
+                                             screen_vertices[0].x, screen_vertices[1].x, screen_vertices[2].x
+                                         }))), 0, width - 1);
+            const int max_x = std::clamp(static_cast<int>(std::ceil(std::max({
+                                             screen_vertices[0].x, screen_vertices[1].x, screen_vertices[2].x
+                                         }))), 0, width - 1);
+            const int min_y = std::max(rows.begin, std::clamp(static_cast<int>(std::floor(std::min({
+                                                                  screen_vertices[0].y, screen_vertices[1].y,
+                                                                  screen_vertices[2].y
+                                                              }))), 0, height - 1));
+            const int max_y = std::min(rows.end - 1, std::clamp(static_cast<int>(std::ceil(std::max({
+                                                                    screen_vertices[0].y, screen_vertices[1].y,
+                                                                    screen_vertices[2].y
+                                                                }))), 0, height - 1));
+            const Vec2f v0(screen_vertices[1].x - screen_vertices[0].x,
+                           screen_vertices[1].y - screen_vertices[0].y);
+            const Vec2f v1(screen_vertices[2].x - screen_vertices[0].x,
+                           screen_vertices[2].y - screen_vertices[0].y);
+
+            const float dot00 = v0.x * v0.x + v0.y * v0.y;
+            const float dot01 = v0.x * v1.x + v0.y * v1.y;
+            const float dot11 = v1.x * v1.x + v1.y * v1.y;
+            const float denom = dot00 * dot11 - dot01 * dot01;
+
+            if (min_y > max_y || std::abs(denom) < 1e-6f)
+            {
+                if (stats)
+                {
+                    ++stats->triangles_culled;
+                }
+                return;
+            }
+
+            const float inv_denom = 1.0f / denom;
+            const float du_dx = (dot11 * v0.x - dot01 * v1.x) * inv_denom;
+            const float dv_dx = (dot00 * v1.x - dot01 * v0.x) * inv_denom;
+
+            uint64_t covered = 0;
+            for (int y = min_y; y <= max_y; ++y)
+            {
+                const Vec2f v2(static_cast<float>(min_x) - screen_vertices[0].x,
                                static_cast<float>(y) - screen_vertices[0].y);
                 const float dot02 = v0.x * v2.x + v0.y * v2.y;
                 const float dot12 = v1.x * v2.x + v1.y * v2.y;
 
-                const float u = (dot11 * dot02 - dot01 * dot12) * inv_denom;
-                const float v = (dot00 * dot12 - dot01 * dot02) * inv_denom;
+                float u = (dot11 * dot02 - dot01 * dot12) * inv_denom;
+                float v = (dot00 * dot12 - dot01 * dot02) * inv_denom;
+
+                for (int x = min_x; x <= max_x; ++x, u += du_dx, v += dv_dx)
+                {
+                    if (u < 0.0f || v < 0.0f || (u + v) > 1.0f)
+                    {
+                        continue;
+                    }
+
+                    const float w = 1.0f - u - v;
+                    const float z = screen_vertices[0].z * w +
+                        screen_vertices[1].z * u +
+                        screen_vertices[2].z * v;
+                    ++covered;
+                    pixel(x, y, w, u, v, z);
+                }
+                span_end(y);
+            }
+
+            if (stats)
+            {
+                ++stats->triangles_rasterized;
+                stats->pixels_tested += covered;
+            }
+        }
+
+        template <typename PixelFn>
+        void rasterize(const std::array<Vec4f, 3>& screen_vertices,
+                       int width,
+                       int height,
+                       const RowRange& rows,
+                       PixelFn&& pixel)
+        {
+            rasterize(screen_vertices, width, height, rows, pixel, [](int) {});
+        }
+
+        template <DepthTest Test, typename Depth>
+        bool depth_test(const Depth& depth, int x, int y, typename Depth::Value value)
+        {
+            if constexpr (Test == DepthTest::Equal)
+            {
+                return depth.equals(x, y, value);
+            }
+            else
+            {
+                return depth.passes(x, y, value);
+            }
+        }
+    }
+
+    // `screen_vertices` carry 1/w in their w component. Coverage and depth use
+    // screen-space barycentrics; the ones handed to the shader are
+    // perspective-corrected, which costs one reciprocal for the pixels that
+    // pass the depth test. `Target` is a RenderTarget and `Depth` a
+    // DepthBuffer; both formats are fixed at compile time, so a covered pixel
+    // costs one packed colour store and one depth store (plus the first-touch
+    // fill of a cleared tile).
+    //
+    // Shaders that may discard get late Z: depth is written per fragment,
+    // after fragment() keeps it. The rest get early Z: a whole span is depth
+    // tested and written first, and only its survivors are shaded, in
+    // batches. Both orders produce the same image for such shaders.
+    template <DepthTest Test = DepthTest::Greater, typename Target, typename Depth>
+    void barycentric_triangle(const std::array<Vec4f, 3>& screen_vertices,
+                              Target& target,
+                              Depth& depth,
+                              IShader& shader,
+                              const RowRange& rows = {})
+    {
+        const float inv_w0 = screen_vertices[0].w;
+        const float inv_w1 = screen_vertices[1].w;
+        const float inv_w2 = screen_vertices[2].w;
+        detail::PixelCounts counts;
+
+        if (shader.may_discard())
+        {
+            detail::rasterize(screen_vertices, target.width(), target.height(), rows,
+                              [&](int x, int y, float w, float u, float v, float z)
+                              {
+                                  const typename Depth::Value depth_value = Depth::encode(z);
+                                  if (!detail::depth_test<Test>(depth, x, y, depth_value))
+                                  {
+                                      return;
+                                  }
+                                  counts.passed();
+                                  counts.shaded(x, y);
+
+                                  const float q0 = w * inv_w0;
+                                  const float q1 = u * inv_w1;
+                                  const float q2 = v * inv_w2;
+                                  const float inv_sum = 1.0f / (q0 + q1 + q2);
+
+                                  Vec3f color;
+                                  if (!shader.fragment(Vec3f(q0 * inv_sum, q1 * inv_sum, q2 * inv_sum),
+                                                       Vec2i(x, y), color))
+                                  {
+                                      if constexpr (Test == DepthTest::Greater)
+                                      {
+                                          depth.store(x, y, depth_value);
+                                      }
+                                      target.store(x, y, Target::pack(color));
+                                  }
+                              });
+            return;
+        }
+
+        struct Survivor
+        {
+            int x;
+            float w;
+            float u;
+            float v;
+        };
+        std::array<Survivor, 64> batch;
+        size_t count = 0;
+
+        const auto shade_batch = [&](int y)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                const Survivor& fragment = batch[i];
+                const float q0 = fragment.w * inv_w0;
+                const float q1 = fragment.u * inv_w1;
+                const float q2 = fragment.v * inv_w2;
+                const float inv_sum = 1.0f / (q0 + q1 + q2);
+
+                Vec3f color;
+                shader.fragment(Vec3f(q0 * inv_sum, q1 * inv_sum, q2 * inv_sum), Vec2i(fragment.x, y), color);
+                target.store(fragment.x, y, Target::pack(color));
+                counts.shaded(fragment.x, y);
+            }
+            count = 0;
+        };
+
+        detail::rasterize(screen_vertices, target.width(), target.height(), rows,
+                          [&](int x, int y, float w, float u, float v, float z)
+                          {
+                              const typename Depth::Value depth_value = Depth::encode(z);
+                              if (!detail::depth_test<Test>(depth, x, y, depth_value))
+                              {
+                                  return;
+                              }
+                              counts.passed();
+                              if constexpr (Test == DepthTest::Greater)
+                              {
+                                  depth.store(x, y, depth_value);
+                              }
+                              batch[count++] = {x, w, u, v};
+                              if (count == batch.size())
+                              {
+                                  shade_batch(y);
+                              }
+                          },
+                          shade_batch);
+    }
+
+    // Depth-only fast path for shadow and pre-passes: no shader, no
+    // perspective correction and no colour target, just the depth test and
+    // store. `screen_vertices` are already projected; w is ignored.
+    template <typename Depth>
+    void depth_triangle(const std::array<Vec4f, 3>& screen_vertices, Depth& depth, const RowRange& rows = {})
+    {
+        detail::PixelCounts counts;
+        detail::rasterize(screen_vertices, depth.width(), depth.height(), rows,
+                          [&](int x, int y, float, float, float, float z)
+                          {
+                              const typename Depth::Value depth_value = Depth::encode(z);
+                              if (depth.passes(x, y, depth_value))
+                              {
+                                  counts.passed();
+                                  depth.store(x, y, depth_value);
+                              }
+                          });
+    }
+
+    // Deferred geometry pass: the same depth test as barycentric_triangle,
+    // but a surviving fragment only records shader.surface() in `gbuffer`.
+    // Fragments that a nearer triangle later covers cost no lighting.
+    template <typename Depth, typename Shader>
+    void gbuffer_triangle(const std::array<Vec4f, 3>& screen_vertices,
+                          GBuffer& gbuffer,
+                          Depth& depth,
+                          const Shader& shader,
+                          const RowRange& rows = {})
+    {
+        const float inv_w0 = screen_vertices[0].w;
+        const float inv_w1 = screen_vertices[1].w;
+        const float inv_w2 = screen_vertices[2].w;
+        detail::PixelCounts counts;
+
+        detail::rasterize(screen_vertices, gbuffer.width(), gbuffer.height(), rows,
+                          [&](int x, int y, float w, float u, float v, float z)
+                          {
+                              const typename Depth::Value depth_value = Depth::encode(z);
+                              if (!depth.passes(x, y, depth_value))
+                              {
+                                  return;
+                              }
+                              counts.passed();
+
+                              const float q0 = w * inv_w0;
+                              const float q1 = u * inv_w1;
+                              const float q2 = v * inv_w2;
+                              const float inv_sum = 1.0f / (q0 + q1 + q2);
+
+                              GBufferTexel texel;
+                              shader.surface(Vec3f(q0 * inv_sum, q1 * inv_sum, q2 * inv_sum), texel);
+                              depth.store(x, y, depth_value);
+                              gbuffer.store(x, y, texel);
+                          });
+    }
 
-                if (u < 0.0f || v < 0.0f || (u + v) > 1.0f)
+    // Deferred lighting pass: one shader.shade() per covered pixel in `rows`.
+    // Tiles the geometry pass never touched are skipped without being read.
+    template <typename Target, typename Shader>
+    void shade_gbuffer(const GBuffer& gbuffer, Target& target, const Shader& shader, const RowRange& rows = {})
+    {
+        constexpr int tile = GBuffer::kTileSize;
+        detail::PixelCounts counts;
+        const int y_begin = std::max(rows.begin, 0);
+        const int y_end = std::min(rows.end, gbuffer.height());
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            for (int x0 = 0; x0 < gbuffer.width(); x0 += tile)
+            {
+                if (gbuffer.tile_cleared(x0 / tile, y / tile))
                 {
                     continue;
                 }
+                for (int x = x0; x < std::min(x0 + tile, gbuffer.width()); ++x)
+                {
+                    const GBufferTexel& texel = gbuffer.at(x, y);
+                    if (texel.view_depth != 0.0f)
+                    {
+                        target.store(x, y, Target::pack(shader.shade(texel, Vec2i(x, y))));
+                        counts.shaded(x, y);
+                    }
+                }
+            }
+        }
+    }
+
+    // Visibility-buffer raster pass: depth test and store, then record `id`
+    // (see VisibilityBuffer::pack). No attribute is interpolated here.
+    template <typename Depth>
+    void visibility_triangle(const std::array<Vec4f, 3>& screen_vertices,
+                             VisibilityBuffer& visibility,
+                             Depth& depth,
+                             uint32_t id,
+                             const RowRange& rows = {})
+    {
+        detail::PixelCounts counts;
+        detail::rasterize(screen_vertices, visibility.width(), visibility.height(), rows,
+                          [&](int x, int y, float, float, float, float z)
+                          {
+                              const typename Depth::Value depth_value = Depth::encode(z);
+                              if (depth.passes(x, y, depth_value))
+                              {
+                                  counts.passed();
+                                  depth.store(x, y, depth_value);
+                                  visibility.store(x, y, id);
+                              }
+                          });
+    }
 
-                const float w = 1.0f - u - v;
-                const float z = screen_vertices[0].z * w +
-                    screen_vertices[1].z * u +
-                    screen_vertices[2].z * v;
+    // Visibility-buffer shading pass for one instance: for every pixel in
+    // `rows` showing one of its triangles, re-runs shader.vertex() for that
+    // triangle (only when it differs from the previous pixel's), rebuilds the
+    // barycentrics at the pixel and calls shader.fragment() once.
+    template <typename Target>
+    void shade_visibility(const VisibilityBuffer& visibility,
+                          Target& target,
+                          IShader& shader,
+                          uint32_t instance,
+                          const RowRange& rows = {})
+    {
+        constexpr int tile = VisibilityBuffer::kTileSize;
+        detail::PixelCounts counts;
+        uint32_t current = VisibilityBuffer::kEmpty;
+        std::array<Vec4f, 3> screen_vertices{};
+        Vec2f v0;
+        Vec2f v1;
+        float dot00 = 0.0f;
+        float dot01 = 0.0f;
+        float dot11 = 0.0f;
+        float inv_denom = 0.0f;
 
-                const int index = x + y * width;
-                if (z > zbuffer.at(index))
+        const int y_begin = std::max(rows.begin, 0);
+        const int y_end = std::min(rows.end, visibility.height());
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            for (int x0 = 0; x0 < visibility.width(); x0 += tile)
+            {
+                if (visibility.tile_cleared(x0 / tile, y / tile))
                 {
-                    TGAColor color;
-                    if (!shader.fragment(Vec3f(w, u, v), color))
+                    continue;
+                }
+                for (int x = x0; x < std::min(x0 + tile, visibility.width()); ++x)
+                {
+                    const uint32_t id = visibility.at(x, y);
+                    if (id == VisibilityBuffer::kEmpty || VisibilityBuffer::instance(id) != instance)
+                    {
+                        continue;
+                    }
+                    if (id != current)
+                    {
+                        const int face_index = static_cast<int>(VisibilityBuffer::triangle(id));
+                        for (int vertex_index = 0; vertex_index < 3; ++vertex_index)
+                        {
+                            screen_vertices[vertex_index] = shader.vertex(face_index, vertex_index);
+                        }
+                        // Same setup as detail::rasterize; stored triangles are never degenerate.
+                        v0 = Vec2f(screen_vertices[1].x - screen_vertices[0].x,
+                                   screen_vertices[1].y - screen_vertices[0].y);
+                        v1 = Vec2f(screen_vertices[2].x - screen_vertices[0].x,
+                                   screen_vertices[2].y - screen_vertices[0].y);
+                        dot00 = v0.x * v0.x + v0.y * v0.y;
+                        dot01 = v0.x * v1.x + v0.y * v1.y;
+                        dot11 = v1.x * v1.x + v1.y * v1.y;
+                        inv_denom = 1.0f / (dot00 * dot11 - dot01 * dot01);
+                        current = id;
+                    }
+
+                    const Vec2f v2(static_cast<float>(x) - screen_vertices[0].x,
+                                   static_cast<float>(y) - screen_vertices[0].y);
+                    const float dot02 = v0.x * v2.x + v0.y * v2.y;
+                    const float dot12 = v1.x * v2.x + v1.y * v2.y;
+                    const float u = (dot11 * dot02 - dot01 * dot12) * inv_denom;
+                    const float v = (dot00 * dot12 - dot01 * dot02) * inv_denom;
+                    const float w = 1.0f - u - v;
+
+                    const float q0 = w * screen_vertices[0].w;
+                    const float q1 = u * screen_vertices[1].w;
+                    const float q2 = v * screen_vertices[2].w;
+                    const float inv_sum = 1.0f / (q0 + q1 + q2);
+
+                    Vec3f color;
+                    counts.shaded(x, y);
+                    if (!shader.fragment(Vec3f(q0 * inv_sum, q1 * inv_sum, q2 * inv_sum), Vec2i(x, y), color))
                     {
-                        zbuffer.at(index) = z;
-                        image.set(x, y, color);
+                        target.store(x, y, Target::pack(color));
                     }
                 }
             }
@@ -0,0 +1,786 @@
+#include "sequence_writer.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "image_io.h"
+#include "trace.h"
+
+namespace
+{
+    // Frames that may wait for an earlier one before the encoder picks them
+    // up; submit() blocks frames further ahead than that.
+    constexpr size_t kPendingFrames = 8;
+
+    constexpr int kHistogramBits = 5;
+    constexpr int kHistogramSize = 1 << (3 * kHistogramBits);
+    constexpr int kPaletteSize = 256;
+    constexpr int kMaxLzwCode = 4095;
+
+    constexpr std::array<uint32_t, 256> make_crc_table()
+    {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        return table;
+    }
+
+    constexpr std::array<uint32_t, 256> kCrcTable = make_crc_table();
+
+    uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0)
+    {
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i)
+        {
+            crc = kCrcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    uint32_t read_be32(const unsigned char* p)
+    {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+
+    void put_be32(std::vector<unsigned char>& out, uint32_t value)
+    {
+        out.push_back(static_cast<unsigned char>(value >> 24));
+        out.push_back(static_cast<unsigned char>(value >> 16));
+        out.push_back(static_cast<unsigned char>(value >> 8));
+        out.push_back(static_cast<unsigned char>(value));
+    }
+
+    void put_le16(std::vector<unsigned char>& out, int value)
+    {
+        out.push_back(static_cast<unsigned char>(value & 0xff));
+        out.push_back(static_cast<unsigned char>((value >> 8) & 0xff));
+    }
+
+    void put_bytes(std::vector<unsigned char>& out, const void* data, size_t size)
+    {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        out.insert(out.end(), bytes, bytes + size);
+    }
+
+    // PNG chunk: length, type, payload, CRC over type and payload.
+    void put_png_chunk(std::vector<unsigned char>& out, const char* type, const unsigned char* data, size_t size)
+    {
+        put_be32(out, static_cast<uint32_t>(size));
+        const size_t type_offset = out.size();
+        put_bytes(out, type, 4);
+        put_bytes(out, data, size);
+        put_be32(out, crc32(out.data() + type_offset, size + 4));
+    }
+
+    // Reads image row `y` of the output, honouring the vertical flip.
+    const unsigned char* source_row(const TGAImage& image, int y, bool flip_rows)
+    {
+        const int row = flip_rows ? image.get_height() - 1 - y : y;
+        return image.buffer() + static_cast<size_t>(row) * image.get_width() * image.get_bytespp();
+    }
+
+    void require_colour(const TGAImage& image)
+    {
+        if (!image.buffer() || (image.get_bytespp() != TGAImage::RGB && image.get_bytespp() != TGAImage::RGBA))
+        {
+            throw std::runtime_error("Sequence frames must be RGB or RGBA images");
+        }
+    }
+
+    int histogram_index(const unsigned char* bgr)
+    {
+        constexpr int shift = 8 - kHistogramBits;
+        return ((bgr[2] >> shift) << (2 * kHistogramBits)) | ((bgr[1] >> shift) << kHistogramBits) | (bgr[0] >> shift);
+    }
+
+    // Axis-aligned box of histogram cells, [lo, hi] inclusive per channel.
+    struct ColorBox
+    {
+        std::array<int, 3> lo;
+        std::array<int, 3> hi;
+        uint64_t count = 0;
+    };
+
+    int cell(int r, int g, int b)
+    {
+        return (r << (2 * kHistogramBits)) | (g << kHistogramBits) | b;
+    }
+
+    template <class Visit>
+    void for_each_cell(const ColorBox& box, Visit&& visit)
+    {
+        for (int r = box.lo[0]; r <= box.hi[0]; ++r)
+        {
+            for (int g = box.lo[1]; g <= box.hi[1]; ++g)
+            {
+                for (int b = box.lo[2]; b <= box.hi[2]; ++b)
+                {
+                    visit(cell(r, g, b), r, g, b);
+                }
+            }
+        }
+    }
+
+    // Shrinks the box to the cells that actually hold pixels.
+    void fit_box(ColorBox& box, const std::vector<uint32_t>& histogram)
+    {
+        std::array<int, 3> lo{31, 31, 31};
+        std::array<int, 3> hi{0, 0, 0};
+        uint64_t count = 0;
+        for_each_cell(box, [&](int index, int r, int g, int b)
+        {
+            if (histogram[index] == 0)
+            {
+                return;
+            }
+            count += histogram[index];
+            const std::array<int, 3> c{r, g, b};
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                lo[axis] = std::min(lo[axis], c[axis]);
+                hi[axis] = std::max(hi[axis], c[axis]);
+            }
+        });
+        box.count = count;
+        if (count != 0)
+        {
+            box.lo = lo;
+            box.hi = hi;
+        }
+    }
+
+    int longest_axis(const ColorBox& box)
+    {
+        int axis = 0;
+        for (int a = 1; a < 3; ++a)
+        {
+            if (box.hi[a] - box.lo[a] > box.hi[axis] - box.lo[axis])
+            {
+                axis = a;
+            }
+        }
+        return axis;
+    }
+
+    // Median cut over a 15-bit histogram: repeatedly splits the box with the
+    // largest pixel count times longest-axis extent, at the pixel median of
+    // that axis. Weighting by extent keeps a large but sparse box from
+    // swallowing small distinct colours. Palette entry i is box i's mean.
+    std::vector<ColorBox> median_cut(const std::vector<uint32_t>& histogram, int max_colors)
+    {
+        std::vector<ColorBox> boxes;
+        boxes.reserve(max_colors);
+        ColorBox all{{0, 0, 0}, {31, 31, 31}, 0};
+        fit_box(all, histogram);
+        boxes.push_back(all);
+
+        while (static_cast<int>(boxes.size()) < max_colors)
+        {
+            ColorBox* target = nullptr;
+            uint64_t target_score = 0;
+            for (ColorBox& box : boxes)
+            {
+                const int axis = longest_axis(box);
+                const uint64_t score = box.count * static_cast<uint64_t>(box.hi[axis] - box.lo[axis]);
+                if (score > target_score)
+                {
+                    target = &box;
+                    target_score = score;
+                }
+            }
+            if (!target)
+            {
+                break;
+            }
+
+            const int axis = longest_axis(*target);
+
+            std::array<uint64_t, 32> slices{};
+            for_each_cell(*target, [&](int index, int r, int g, int b)
+            {
+                const std::array<int, 3> c{r, g, b};
+                slices[c[axis]] += histogram[index];
+            });
+
+            int split = target->lo[axis];
+            uint64_t below = slices[split];
+            while (split + 1 < target->hi[axis] && below * 2 < target->count)
+            {
+                below += slices[++split];
+            }
+
+            ColorBox upper = *target;
+            target->hi[axis] = split;
+            upper.lo[axis] = split + 1;
+            fit_box(*target, histogram);
+            fit_box(upper, histogram);
+            boxes.push_back(upper);
+        }
+        return boxes;
+    }
+
+    // Variable-width GIF LZW with an open-addressed dictionary; emits a clear
+    // code whenever the 12-bit code space fills up.
+    class LzwEncoder
+    {
+    public:
+        explicit LzwEncoder(std::vector<unsigned char>& out)
+            : out_(out)
+        {
+            reset_dictionary();
+        }
+
+        void encode(const uint8_t* indices, size_t count)
+        {
+            out_.push_back(kMinCodeSize);
+            block_start_ = out_.size();
+            out_.push_back(0);
+
+            write_code(kClearCode);
+            int prefix = indices[0];
+            for (size_t i = 1; i < count; ++i)
+            {
+                const uint8_t next = indices[i];
+                const uint32_t key = (static_cast<uint32_t>(prefix) << 8 | next) + 1;
+                size_t slot = hash(key);
+                while (keys_[slot] != 0 && keys_[slot] != key)
+                {
+                    slot = (slot + 1) & (kTableSize - 1);
+                }
+                if (keys_[slot] == key)
+                {
+                    prefix = codes_[slot];
+                    continue;
+                }
+
+                write_code(prefix);
+                keys_[slot] = key;
+                codes_[slot] = static_cast<uint16_t>(++max_code_);
+                if (max_code_ >= (1 << code_size_))
+                {
+                    ++code_size_;
+                }
+                if (max_code_ == kMaxLzwCode)
+                {
+                    write_code(kClearCode);
+                    reset_dictionary();
+                }
+                prefix = next;
+            }
+            write_code(prefix);
+            write_code(kEndCode);
+            if (bit_count_ > 0)
+            {
+                put_byte(static_cast<unsigned char>(bits_));
+            }
+            close_block();
+            out_.push_back(0);
+        }
+
+    private:
+        static constexpr int kMinCodeSize = 8;
+        static constexpr int kClearCode = 1 << kMinCodeSize;
+        static constexpr int kEndCode = kClearCode + 1;
+        static constexpr size_t kTableSize = 8192;
+
+        static size_t hash(uint32_t key)
+        {
+            return (key * 2654435761u >> 19) & (kTableSize - 1);
+        }
+
+        void reset_dictionary()
+        {
+            keys_.fill(0);
+            code_size_ = kMinCodeSize + 1;
+            max_code_ = kEndCode;
+        }
+
+        void write_code(int code)
+        {
+            bits_ |= static_cast<uint32_t>(code) << bit_count_;
+            bit_count_ += code_size_;
+            while (bit_count_ >= 8)
+            {
+                put_byte(static_cast<unsigned char>(bits_ & 0xff));
+                bits_ >>= 8;
+                bit_count_ -= 8;
+            }
+        }
+
+        // Data sub-blocks are at most 255 bytes, each prefixed with its length.
+        void put_byte(unsigned char byte)
+        {
+            if (out_.size() - block_start_ - 1 == 255)
+            {
+                close_block();
+                block_start_ = out_.size();
+                out_.push_back(0);
+            }
+            out_.push_back(byte);
+        }
+
+        void close_block()
+        {
+            out_[block_start_] = static_cast<unsigned char>(out_.size() - block_start_ - 1);
+        }
+
+        std::vector<unsigned char>& out_;
+        std::array<uint32_t, kTableSize> keys_{};
+        std::array<uint16_t, kTableSize> codes_{};
+        int code_size_ = kMinCodeSize + 1;
+        int max_code_ = kEndCode;
+        uint32_t bits_ = 0;
+        int bit_count_ = 0;
+        size_t block_start_ = 0;
+    };
+}
+
+SequenceWriter::SequenceWriter(const String& path, int width, int height, int frames_per_second)
+    : format_(format_from_path(path)),
+      path_(path),
+      width_(width),
+      height_(height),
+      frames_per_second_(std::max(1, frames_per_second)),
+      out_(path, std::ios::binary | std::ios::trunc),
+      queue_(kPendingFrames)
+{
+    if (!out_)
+    {
+        throw std::runtime_error("Cannot create sequence file: " + path);
+    }
+    pending_.reserve(kPendingFrames);
+
+    if (format_ == SequenceFormat::GIF)
+    {
+        put_bytes(buffer_, "GIF89a", 6);
+        put_le16(buffer_, width_);
+        put_le16(buffer_, height_);
+        // No global colour table (every frame brings its own), 8-bit colour resolution.
+        buffer_.insert(buffer_.end(), {0x70, 0x00, 0x00});
+        // NETSCAPE2.0 application extension: loop forever.
+        buffer_.insert(buffer_.end(), {0x21, 0xff, 0x0b});
+        put_bytes(buffer_, "NETSCAPE2.0", 11);
+        buffer_.insert(buffer_.end(), {0x03, 0x01, 0x00, 0x00, 0x00});
+        flush_buffer();
+    }
+    else if (format_ == SequenceFormat::Y4M)
+    {
+        const std::string header = "YUV4MPEG2 W" + std::to_string(width_) + " H" + std::to_string(height_) +
+            " F" + std::to_string(frames_per_second_) + ":1 Ip A1:1 C420jpeg\n";
+        put_bytes(buffer_, header.data(), header.size());
+        flush_buffer();
+    }
+
+    thread_ = std::thread(&SequenceWriter::worker, this);
+}
+
+SequenceWriter::~SequenceWriter()
+{
+    if (!finished_)
+    {
+        queue_.close();
+        thread_.join();
+        for (Frame& frame : pending_)
+        {
+            if (frame.release)
+            {
+                frame.release();
+            }
+        }
+    }
+}
+
+SequenceFormat SequenceWriter::format_from_path(const String& path)
+{
+    String extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (extension == ".gif")
+    {
+        return SequenceFormat::GIF;
+    }
+    if (extension == ".png" || extension == ".apng")
+    {
+        return SequenceFormat::APNG;
+    }
+    if (extension == ".y4m")
+    {
+        return SequenceFormat::Y4M;
+    }
+    throw std::runtime_error("Unknown sequence format: " + path);
+}
+
+void SequenceWriter::submit(int frame, const TGAImage& image, bool flip_rows, std::function<void()> release)
+{
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+    // Every frame below next_frame_ has been handed over, so at most
+    // kPendingFrames - 1 can be waiting, and frame next_frame_ never blocks.
+    pending_space_.wait(lock, [this, frame]
+    {
+        return frame < next_frame_ + static_cast<int>(kPendingFrames);
+    });
+    pending_.push_back(Frame{frame, &image, flip_rows, std::move(release)});
+
+    // Hand over every frame that is now contiguous with what was already queued.
+    for (auto ready = pending_.end(); ; )
+    {
+        ready = std::find_if(pending_.begin(), pending_.end(),
+                             [this](const Frame& pending) { return pending.index == next_frame_; });
+        if (ready == pending_.end())
+        {
+            break;
+        }
+        Frame next = std::move(*ready);
+        pending_.erase(ready);
+        ++next_frame_;
+        queue_.push(std::move(next));
+        pending_space_.notify_all();
+    }
+}
+
+void SequenceWriter::finish()
+{
+    if (finished_)
+    {
+        return;
+    }
+    finished_ = true;
+    queue_.close();
+    thread_.join();
+
+    const bool missing_frames = !pending_.empty();
+    for (Frame& frame : pending_)
+    {
+        if (frame.release)
+        {
+            frame.release();
+        }
+    }
+    pending_.clear();
+
+    if (error_)
+    {
+        std::rethrow_exception(error_);
+    }
+    if (missing_frames)
+    {
+        throw std::runtime_error("Sequence is missing frame " + std::to_string(next_frame_) + ": " + path_);
+    }
+
+    write_trailer();
+    out_.close();
+    if (!out_)
+    {
+        throw std::runtime_error("Failed to write sequence file: " + path_);
+    }
+}
+
+void SequenceWriter::worker()
+{
+    trace::set_thread_name("sequence encoder");
+    while (std::optional<Frame> frame = queue_.pop())
+    {
+        if (!error_)
+        {
+            try
+            {
+                encode(*frame);
+            }
+            catch (...)
+            {
+                error_ = std::current_exception();
+            }
+        }
+        if (frame->release)
+        {
+            frame->release();
+        }
+    }
+}
+
+void SequenceWriter::encode(const Frame& frame)
+{
+    require_colour(*frame.image);
+    if (frame.image->get_width() != width_ || frame.image->get_height() != height_)
+    {
+        throw std::runtime_error("Sequence frame size does not match: " + path_);
+    }
+
+    {
+        const trace::Scope scope("encode");
+        switch (format_)
+        {
+        case SequenceFormat::GIF:
+            encode_gif(*frame.image, frame.flip_rows);
+            break;
+        case SequenceFormat::APNG:
+            encode_apng(*frame.image, frame.flip_rows);
+            break;
+        case SequenceFormat::Y4M:
+            encode_y4m(*frame.image, frame.flip_rows);
+            break;
+        }
+    }
+    const trace::Scope scope("write");
+    flush_buffer();
+    if (!out_)
+    {
+        throw std::runtime_error("Failed to write sequence file: " + path_);
+    }
+    ++frames_written_;
+}
+
+void SequenceWriter::encode_gif(const TGAImage& image, bool flip_rows)
+{
+    const int channels = image.get_bytespp();
+    histogram_.assign(kHistogramSize, 0);
+    for (int y = 0; y < height_; ++y)
+    {
+        const unsigned char* row = source_row(image, y, flip_rows);
+        for (int x = 0; x < width_; ++x)
+        {
+            ++histogram_[histogram_index(row + x * channels)];
+        }
+    }
+
+    // Each frame is quantised on its own, so nothing about later frames has to
+    // be known (or kept) when this one is written.
+    const std::vector<ColorBox> boxes = median_cut(histogram_, kPaletteSize);
+    palette_lookup_.resize(kHistogramSize);
+    std::array<unsigned char, kPaletteSize * 3> palette{};
+    for (size_t i = 0; i < boxes.size(); ++i)
+    {
+        std::array<uint64_t, 3> sum{};
+        for_each_cell(boxes[i], [&](int index, int r, int g, int b)
+        {
+            sum[0] += static_cast<uint64_t>(histogram_[index]) * ((r << 3) | 4);
+            sum[1] += static_cast<uint64_t>(histogram_[index]) * ((g << 3) | 4);
+            sum[2] += static_cast<uint64_t>(histogram_[index]) * ((b << 3) | 4);
+        });
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[i * 3 + c] = static_cast<unsigned char>(boxes[i].count ? sum[c] / boxes[i].count : 0);
+        }
+    }
+
+    // A box's mean can lie far from some of its cells, so every occupied cell
+    // takes the nearest palette colour rather than its own box's.
+    for (int index = 0; index < kHistogramSize; ++index)
+    {
+        if (histogram_[index] == 0)
+        {
+            continue;
+        }
+        const std::array<int, 3> center{
+            (index >> (2 * kHistogramBits)) << 3 | 4,
+            (index >> kHistogramBits & ((1 << kHistogramBits) - 1)) << 3 | 4,
+            (index & ((1 << kHistogramBits) - 1)) << 3 | 4};
+        int best = 0;
+        int best_distance = std::numeric_limits<int>::max();
+        for (size_t i = 0; i < boxes.size(); ++i)
+        {
+            int distance = 0;
+            for (int c = 0; c < 3; ++c)
+            {
+                const int delta = center[c] - palette[i * 3 + c];
+                distance += delta * delta;
+            }
+            if (distance < best_distance)
+            {
+                best = static_cast<int>(i);
+                best_distance = distance;
+            }
+        }
+        palette_lookup_[index] = static_cast<uint8_t>(best);
+    }
+
+    scratch_.resize(static_cast<size_t>(width_) * height_);
+    for (int y = 0; y < height_; ++y)
+    {
+        const unsigned char* row = source_row(image, y, flip_rows);
+        uint8_t* indices = scratch_.data() + static_cast<size_t>(y) * width_;
+        for (int x = 0; x < width_; ++x)
+        {
+            indices[x] = palette_lookup_[histogram_index(row + x * channels)];
+        }
+    }
+
+    // Graphic control extension: keep the previous frame, delay in 1/100 s.
+    buffer_.insert(buffer_.end(), {0x21, 0xf9, 0x04, 0x04});
+    put_le16(buffer_, (100 + frames_per_second_ / 2) / frames_per_second_);
+    buffer_.insert(buffer_.end(), {0x00, 0x00});
+
+    // Image descriptor with a 256-entry local colour table.
+    buffer_.push_back(0x2c);
+    put_le16(buffer_, 0);
+    put_le16(buffer_, 0);
+    put_le16(buffer_, width_);
+    put_le16(buffer_, height_);
+    buffer_.push_back(0x87);
+    put_bytes(buffer_, palette.data(), palette.size());
+
+    LzwEncoder lzw(buffer_);
+    lzw.encode(scratch_.data(), scratch_.size());
+}
+
+void SequenceWriter::encode_apng(const TGAImage& image, bool flip_rows)
+{
+    // stb_image_write does the filtering and deflate; its IDAT payload is
+    // re-wrapped as this frame's image data.
+    image_io::encode_png(image, flip_rows, scratch_);
+
+    constexpr size_t signature_size = 8;
+    const unsigned char* png = scratch_.data();
+    const size_t png_size = scratch_.size();
+
+    if (frames_written_ == 0)
+    {
+        put_bytes(buffer_, png, signature_size);
+        // IHDR is the first chunk: length 13, plus 12 bytes of framing.
+        put_bytes(buffer_, png + signature_size, 12 + read_be32(png + signature_size));
+
+        unsigned char actl[8] = {};
+        apng_frame_count_offset_ = static_cast<std::streamoff>(out_.tellp()) +
+            static_cast<std::streamoff>(buffer_.size());
+        put_png_chunk(buffer_, "acTL", actl, sizeof(actl));
+    }
+
+    std::array<unsigned char, 26> fctl{};
+    const auto set_be32 = [&fctl](size_t offset, uint32_t value)
+    {
+        fctl[offset] = static_cast<unsigned char>(value >> 24);
+        fctl[offset + 1] = static_cast<unsigned char>(value >> 16);
+        fctl[offset + 2] = static_cast<unsigned char>(value >> 8);
+        fctl[offset + 3] = static_cast<unsigned char>(value);
+    };
+    set_be32(0, apng_sequence_++);
+    set_be32(4, static_cast<uint32_t>(width_));
+    set_be32(8, static_cast<uint32_t>(height_));
+    // x/y offsets stay zero; delay is 1/fps seconds; dispose and blend ops are NONE/SOURCE.
+    fctl[20] = 0;
+    fctl[21] = 1;
+    fctl[22] = static_cast<unsigned char>(frames_per_second_ >> 8);
+    fctl[23] = static_cast<unsigned char>(frames_per_second_);
+    put_png_chunk(buffer_, "fcTL", fctl.data(), fctl.size());
+
+    size_t offset = signature_size;
+    while (offset + 12 <= png_size)
+    {
+        const uint32_t length = read_be32(png + offset);
+        const unsigned char* type = png + offset + 4;
+        const unsigned char* data = type + 4;
+        if (std::memcmp(type, "IDAT", 4) == 0)
+        {
+            if (frames_written_ == 0)
+            {
+                put_bytes(buffer_, png + offset, 12 + length);
+            }
+            else
+            {
+                put_be32(buffer_, length + 4);
+                const size_t type_offset = buffer_.size();
+                put_bytes(buffer_, "fdAT", 4);
+                put_be32(buffer_, apng_sequence_++);
+                put_bytes(buffer_, data, length);
+                put_be32(buffer_, crc32(buffer_.data() + type_offset, length + 8));
+            }
+        }
+        offset += 12 + length;
+    }
+}
+
+void SequenceWriter::encode_y4m(const TGAImage& image, bool flip_rows)
+{
+    const int channels = image.get_bytespp();
+    const int chroma_width = (width_ + 1) / 2;
+    const int chroma_height = (height_ + 1) / 2;
+    const size_t luma_size = static_cast<size_t>(width_) * height_;
+    const size_t chroma_size = static_cast<size_t>(chroma_width) * chroma_height;
+
+    put_bytes(buffer_, "FRAME\n", 6);
+    const size_t planes = buffer_.size();
+    buffer_.resize(planes + luma_size + 2 * chroma_size);
+    unsigned char* luma = buffer_.data() + planes;
+    unsigned char* cb = luma + luma_size;
+    unsigned char* cr = cb + chroma_size;
+
+    // BT.601 studio range, chroma averaged over each 2x2 block.
+    for (int cy = 0; cy < chroma_height; ++cy)
+    {
+        for (int cx = 0; cx < chroma_width; ++cx)
+        {
+            int sum_r = 0;
+            int sum_g = 0;
+            int sum_b = 0;
+            int samples = 0;
+            for (int y = cy * 2; y < std::min(cy * 2 + 2, height_); ++y)
+            {
+                const unsigned char* row = source_row(image, y, flip_rows);
+                for (int x = cx * 2; x < std::min(cx * 2 + 2, width_); ++x)
+                {
+                    const unsigned char* bgr = row + x * channels;
+                    const int r = bgr[2];
+                    const int g = bgr[1];
+                    const int b = bgr[0];
+                    luma[static_cast<size_t>(y) * width_ + x] =
+                        static_cast<unsigned char>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+                    sum_r += r;
+                    sum_g += g;
+                    sum_b += b;
+                    ++samples;
+                }
+            }
+            const int r = sum_r / samples;
+            const int g = sum_g / samples;
+            const int b = sum_b / samples;
+            const size_t index = static_cast<size_t>(cy) * chroma_width + cx;
+            cb[index] = static_cast<unsigned char>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            cr[index] = static_cast<unsigned char>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+}
+
+void SequenceWriter::write_trailer()
+{
+    if (format_ == SequenceFormat::GIF)
+    {
+        buffer_.push_back(0x3b);
+        flush_buffer();
+    }
+    else if (format_ == SequenceFormat::APNG && frames_written_ > 0)
+    {
+        put_png_chunk(buffer_, "IEND", nullptr, 0);
+        flush_buffer();
+
+        // The frame count is only known now; patch acTL in place.
+        unsigned char actl[8] = {};
+        actl[0] = static_cast<unsigned char>(frames_written_ >> 24);
+        actl[1] = static_cast<unsigned char>(frames_written_ >> 16);
+        actl[2] = static_cast<unsigned char>(frames_written_ >> 8);
+        actl[3] = static_cast<unsigned char>(frames_written_);
+        put_png_chunk(buffer_, "acTL", actl, sizeof(actl));
+        out_.seekp(apng_frame_count_offset_);
+        flush_buffer();
+        out_.seekp(0, std::ios::end);
+    }
+}
+
+void SequenceWriter::flush_buffer()
+{
+    out_.write(reinterpret_cast<const char*>(buffer_.data()), static_cast<std::streamsize>(buffer_.size()));
+    buffer_.clear();
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "geometry.h"
+#include "libs/tgaimage.h"
+
+enum class SequenceFormat
+{
+    // Looping animation, one median-cut palette per frame.
+    GIF,
+    // Looping animation, lossless.
+    APNG,
+    // Raw YUV 4:2:0 stream for video encoders.
+    Y4M
+};
+
+// Appends frames to a single animated file as they finish, so a sequence is
+// never held in memory as a whole. Frames may be submitted out of order (as
+// frame-parallel rendering produces them); they are encoded strictly in
+// order on a background thread.
+class SequenceWriter
+{
+public:
+    // Picks the format from the extension: .gif, .png/.apng or .y4m. Throws
+    // std::runtime_error for anything else or when the file cannot be created.
+    SequenceWriter(const String& path, int width, int height, int frames_per_second);
+    ~SequenceWriter();
+
+    SequenceWriter(const SequenceWriter&) = delete;
+    SequenceWriter& operator=(const SequenceWriter&) = delete;
+
+    static SequenceFormat format_from_path(const String& path);
+
+    // `image` is borrowed until `release` runs on the encoder thread. Blocks
+    // while `frame` is too far ahead of the oldest frame not yet submitted.
+    void submit(int frame, const TGAImage& image, bool flip_rows, std::function<void()> release);
+
+    // Encodes everything submitted, writes the trailer and closes the file;
+    // rethrows the first encoding error.
+    void finish();
+
+    [[nodiscard]] SequenceFormat format() const { return format_; }
+
+private:
+    struct Frame
+    {
+        int index = 0;
+        const TGAImage* image = nullptr;
+        bool flip_rows = false;
+        std::function<void()> release;
+    };
+
+    void worker();
+    void encode(const Frame& frame);
+    void encode_gif(const TGAImage& image, bool flip_rows);
+    void encode_apng(const TGAImage& image, bool flip_rows);
+    void encode_y4m(const TGAImage& image, bool flip_rows);
+    void write_trailer();
+    void flush_buffer();
+
+    SequenceFormat format_;
+    String path_;
+    int width_;
+    int height_;
+    int frames_per_second_;
+    std::ofstream out_;
+
+    std::mutex pending_mutex_;
+    std::condition_variable pending_space_;
+    std::vector<Frame> pending_;
+    int next_frame_ = 0;
+
+    BoundedQueue<Frame> queue_;
+    std::thread thread_;
+    std::exception_ptr error_;
+    bool finished_ = false;
+
+    // Encoder-thread state, reused from frame to frame.
+    int frames_written_ = 0;
+    uint32_t apng_sequence_ = 0;
+    std::streamoff apng_frame_count_offset_ = 0;
+    std::vector<unsigned char> buffer_;
+    std::vector<unsigned char> scratch_;
+    std::vector<uint32_t> histogram_;
+    std::vector<uint8_t> palette_lookup_;
+};
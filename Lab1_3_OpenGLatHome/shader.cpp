@@ -1,6 +1,7 @@
 #include "shader.h"
 
 #include <algorithm>
+#include <cmath>
 
 BasicShader::BasicShader(const Model& model,
                          const Camera& camera,
@@ -13,19 +14,19 @@ BasicShader::BasicShader(const Model& model,
 {
 }
 
-Vec3f BasicShader::vertex(int face_index, int vertex_index)
+Vec4f BasicShader::vertex(int face_index, int vertex_index)
 {
     const std::vector<int>& face = model_.face(face_index);
     const Vec3f world = model_.vert(face.at(vertex_index));
 
     world_coords_[vertex_index] = world;
-    const Vec3f projected = camera_.project(world);
+    const Vec4f projected = camera_.project_homogeneous(world);
     screen_coords_[vertex_index] = projected;
     uv_coords_[vertex_index] = model_.texcoord(face_index, vertex_index);
     return projected;
 }
 
-bool BasicShader::fragment(const Vec3f& barycentric, TGAColor& color)
+bool BasicShader::fragment(const Vec3f& barycentric, const Vec2i&, Vec3f& color)
 {
     const Vec3f v0 = world_coords_[1] - world_coords_[0];
     const Vec3f v1 = world_coords_[2] - world_coords_[0];
@@ -48,10 +49,7 @@ bool BasicShader::fragment(const Vec3f& barycentric, TGAColor& color)
         final_color.z *= tex_color.z;
     }
 
-    const unsigned char r = static_cast<unsigned char>(std::clamp(final_color.x, 0.0f, 1.0f) * 255.0f);
-    const unsigned char g = static_cast<unsigned char>(std::clamp(final_color.y, 0.0f, 1.0f) * 255.0f);
-    const unsigned char b = static_cast<unsigned char>(std::clamp(final_color.z, 0.0f, 1.0f) * 255.0f);
-    color = TGAColor(r, g, b, 255);
+    color = final_color;
     return false;
 }
 
@@ -61,31 +59,139 @@ PhongShader::PhongShader(const Model& model,
                          const Texture* texture,
                          float ambient_strength,
                          float specular_strength,
-                         float shininess)
+                         float shininess,
+                         ShadingPrecision precision)
+    : PhongShader(model, camera, std::span<const Light>(&light, 1), nullptr, texture,
+                  ambient_strength, specular_strength, shininess, precision)
+{
+}
+
+PhongShader::PhongShader(const Model& model,
+                         const Camera& camera,
+                         std::span<const Light> lights,
+                         const LightGrid* light_grid,
+                         const Texture* texture,
+                         float ambient_strength,
+                         float specular_strength,
+                         float shininess,
+                         ShadingPrecision precision)
     : model_(model),
       camera_(camera),
-      light_(light),
+      lights_(lights),
+      light_grid_(light_grid),
       texture_(texture),
+      ambient_(0.0f, 0.0f, 0.0f),
       ambient_strength_(ambient_strength),
       specular_strength_(specular_strength),
-      shininess_(shininess)
+      shininess_(shininess),
+      specular_table_(precision == ShadingPrecision::Fast ? &fast_math::SpecularTable::get(shininess) : nullptr)
 {
+    bool first = true;
+    for (const Light& light : lights_)
+    {
+        if (light.get_type() != LightType::Directional)
+        {
+            continue;
+        }
+        const Vec3f ambient = light.get_color() * ambient_strength_;
+        ambient_ = first ? ambient : ambient_ + ambient;
+        first = false;
+    }
+}
+
+void PhongShader::set_shadow_map(const ShadowMap* shadow_map, size_t light_index)
+{
+    shadow_map_ = shadow_map;
+    shadow_light_ = light_index;
 }
 
-Vec3f PhongShader::vertex(int face_index, int vertex_index)
+float PhongShader::specular_error_bound() const
+{
+    if (!specular_table_)
+    {
+        return 0.0f;
+    }
+    float intensity = 0.0f;
+    for (const Light& light : lights_)
+    {
+        intensity += light.max_intensity();
+    }
+    return specular_table_->max_error() * specular_strength_ * intensity;
+}
+
+Vec4f PhongShader::vertex(int face_index, int vertex_index)
 {
     const std::vector<int>& face = model_.face(face_index);
     const Vec3f world = model_.vert(face.at(vertex_index));
 
     world_coords_[vertex_index] = world;
-    const Vec3f projected = camera_.project(world);
+    const Vec4f projected = camera_.project_homogeneous(world);
     screen_coords_[vertex_index] = projected;
     uv_coords_[vertex_index] = model_.texcoord(face_index, vertex_index);
     normals_[vertex_index] = model_.normal(face.at(vertex_index));
     return projected;
 }
 
-bool PhongShader::fragment(const Vec3f& barycentric, TGAColor& color)
+void PhongShader::add_light(size_t index, const Vec3f& normal, const Vec3f& frag_pos,
+                            Vec3f& diffuse, float& specular) const
+{
+    const Light& light = lights_[index];
+    LightSample sample = light.illuminate(frag_pos);
+    if (sample.intensity <= 0.0f)
+    {
+        return;
+    }
+    const Vec3f light_dir = sample.direction;
+
+    const float diff = std::max(0.0f, normal.dot(light_dir));
+    if (shadow_map_ && index == shadow_light_ && diff > 0.0f)
+    {
+        sample.intensity *= shadow_map_->visibility(frag_pos, normal);
+    }
+    diffuse = diffuse + light.get_color() * diff * sample.intensity;
+
+    if (diff > 0.0f)
+    {
+        const Vec3f reflect_dir = (normal * (2.0f * normal.dot(light_dir))) - light_dir;
+        const Vec3f view_dir = (camera_.get_position() - frag_pos).normalized();
+        const float cos_angle = std::max(0.0f, reflect_dir.dot(view_dir));
+        const float spec = specular_table_ ? (*specular_table_)(cos_angle) : std::pow(cos_angle, shininess_);
+        specular += spec * specular_strength_ * sample.intensity;
+    }
+}
+
+Vec3f PhongShader::lit_color(const Vec3f& normal, const Vec3f& frag_pos, const Vec2f& uv, const Vec2i& pixel) const
+{
+    Vec3f diffuse(0.0f, 0.0f, 0.0f);
+    float specular = 0.0f;
+    if (light_grid_)
+    {
+        for (const uint16_t index : light_grid_->lights_at(pixel.x, pixel.y))
+        {
+            add_light(index, normal, frag_pos, diffuse, specular);
+        }
+    }
+    else
+    {
+        for (size_t index = 0; index < lights_.size(); ++index)
+        {
+            add_light(index, normal, frag_pos, diffuse, specular);
+        }
+    }
+
+    Vec3f final_color = ambient_ + diffuse + Vec3f(specular, specular, specular);
+
+    if (texture_ && texture_->is_valid())
+    {
+        const Vec3f tex_color = texture_->sample(uv);
+        final_color.x *= tex_color.x;
+        final_color.y *= tex_color.y;
+        final_color.z *= tex_color.z;
+    }
+    return final_color;
+}
+
+bool PhongShader::fragment(const Vec3f& barycentric, const Vec2i& pixel, Vec3f& color)
 {
     const Vec3f normal = (normals_[0] * barycentric.x +
                           normals_[1] * barycentric.y +
@@ -95,39 +201,190 @@ bool PhongShader::fragment(const Vec3f& barycentric, TGAColor& color)
                            world_coords_[1] * barycentric.y +
                            world_coords_[2] * barycentric.z;
 
-    const Vec3f light_dir = light_.get_direction();
+    const Vec2f uv = uv_coords_[0] * barycentric.x +
+                     uv_coords_[1] * barycentric.y +
+                     uv_coords_[2] * barycentric.z;
+
+    color = lit_color(normal, frag_pos, uv, pixel);
+    return false;
+}
+
+void PhongShader::surface(const Vec3f& barycentric, GBufferTexel& texel) const
+{
+    const Vec3f normal = (normals_[0] * barycentric.x +
+                          normals_[1] * barycentric.y +
+                          normals_[2] * barycentric.z).normalized();
+
+    const Vec3f frag_pos = world_coords_[0] * barycentric.x +
+                           world_coords_[1] * barycentric.y +
+                           world_coords_[2] * barycentric.z;
+
+    texel.uv = uv_coords_[0] * barycentric.x +
+               uv_coords_[1] * barycentric.y +
+               uv_coords_[2] * barycentric.z;
+    texel.view_depth = camera_.view_depth(frag_pos);
+    texel.normal = gbuffer::encode_normal(normal);
+    texel.material = gbuffer::kNoMaterial;
+}
+
+Vec3f PhongShader::shade(const GBufferTexel& texel, const Vec2i& pixel) const
+{
+    const Vec3f frag_pos = camera_.unproject(static_cast<float>(pixel.x), static_cast<float>(pixel.y),
+                                             texel.view_depth);
+    return lit_color(gbuffer::decode_normal(texel.normal), frag_pos, texel.uv, pixel);
+}
+
+MaterialShader::MaterialShader(const Model& model,
+                               const Camera& camera,
+                               const Light& light,
+                               const MaterialSet& materials,
+                               float ambient_strength,
+                               float specular_strength)
+    : model_(model),
+      camera_(camera),
+      light_(light),
+      materials_(materials),
+      ambient_strength_(ambient_strength),
+      specular_strength_(specular_strength)
+{
+}
 
+Vec4f MaterialShader::vertex(int face_index, int vertex_index)
+{
+    const std::vector<int>& face = model_.face(face_index);
+    const Vec3f world = model_.vert(face.at(vertex_index));
+
+    if (vertex_index == 0)
+    {
+        const int material_index = model_.face_material(face_index);
+        const bool has_material = material_index >= 0 && material_index < static_cast<int>(materials_.size());
+        material_index_ = material_index;
+        material_ = has_material ? &model_.materials()[material_index] : nullptr;
+        textures_ = has_material ? &materials_.textures(material_index) : nullptr;
+    }
+
+    world_coords_[vertex_index] = world;
+    const Vec4f projected = camera_.project_homogeneous(world);
+    screen_coords_[vertex_index] = projected;
+    uv_coords_[vertex_index] = model_.texcoord(face_index, vertex_index);
+    normals_[vertex_index] = model_.normal(face.at(vertex_index));
+    tangents_[vertex_index] = model_.tangent(face.at(vertex_index));
+    return projected;
+}
+
+bool MaterialShader::fragment(const Vec3f& barycentric, const Vec2i&, Vec3f& color)
+{
+    const Vec3f frag_pos = world_coords_[0] * barycentric.x +
+                           world_coords_[1] * barycentric.y +
+                           world_coords_[2] * barycentric.z;
+
+    const Vec2f uv = uv_coords_[0] * barycentric.x +
+                     uv_coords_[1] * barycentric.y +
+                     uv_coords_[2] * barycentric.z;
+
+    float metalness = 0.0f;
+    float roughness = 1.0f;
+    const Vec3f normal = surface_normal(barycentric, uv, metalness, roughness);
+    color = lit_color(albedo(material_, textures_, uv), normal, metalness, roughness, frag_pos);
+    return false;
+}
+
+void MaterialShader::surface(const Vec3f& barycentric, GBufferTexel& texel) const
+{
+    const Vec3f frag_pos = world_coords_[0] * barycentric.x +
+                           world_coords_[1] * barycentric.y +
+                           world_coords_[2] * barycentric.z;
+
+    texel.uv = uv_coords_[0] * barycentric.x +
+               uv_coords_[1] * barycentric.y +
+               uv_coords_[2] * barycentric.z;
+
+    float metalness = 0.0f;
+    float roughness = 1.0f;
+    texel.normal = gbuffer::encode_normal(surface_normal(barycentric, texel.uv, metalness, roughness));
+    texel.view_depth = camera_.view_depth(frag_pos);
+    texel.material = material_ ? static_cast<uint16_t>(material_index_) : gbuffer::kNoMaterial;
+    texel.metalness = gbuffer::to_unorm8(metalness);
+    texel.roughness = gbuffer::to_unorm8(roughness);
+}
+
+Vec3f MaterialShader::shade(const GBufferTexel& texel, const Vec2i& pixel) const
+{
+    const Vec3f frag_pos = camera_.unproject(static_cast<float>(pixel.x), static_cast<float>(pixel.y),
+                                             texel.view_depth);
+    const bool has_material = texel.material != gbuffer::kNoMaterial;
+    const Material* material = has_material ? &model_.materials()[texel.material] : nullptr;
+    const MaterialTextures* textures = has_material ? &materials_.textures(texel.material) : nullptr;
+    return lit_color(albedo(material, textures, texel.uv), gbuffer::decode_normal(texel.normal),
+                     fast_math::kByteToFloat[texel.metalness], fast_math::kByteToFloat[texel.roughness], frag_pos);
+}
+
+Vec3f MaterialShader::albedo(const Material* material, const MaterialTextures* textures, const Vec2f& uv)
+{
+    Vec3f albedo = material ? material->diffuse_color : Vec3f(1.0f, 1.0f, 1.0f);
+    if (textures && textures->diffuse && textures->diffuse->is_valid())
+    {
+        const Vec3f tex_color = textures->diffuse->sample(uv);
+        albedo = Vec3f(albedo.x * tex_color.x, albedo.y * tex_color.y, albedo.z * tex_color.z);
+    }
+    return albedo;
+}
+
+Vec3f MaterialShader::surface_normal(const Vec3f& barycentric, const Vec2f& uv,
+                                     float& metalness, float& roughness) const
+{
+    const Vec3f vertex_normal = (normals_[0] * barycentric.x +
+                                 normals_[1] * barycentric.y +
+                                 normals_[2] * barycentric.z).normalized();
+
+    metalness = material_ ? material_->metalness : 0.0f;
+    roughness = material_ ? material_->roughness : 1.0f;
+    if (!textures_ || !textures_->surface)
+    {
+        return vertex_normal;
+    }
+
+    const SurfaceSample surface = textures_->surface->sample(uv);
+    metalness *= surface.metalness;
+    roughness *= surface.roughness;
+
+    const Vec3f interpolated_tangent = (tangents_[0].xyz() * barycentric.x +
+                                        tangents_[1].xyz() * barycentric.y +
+                                        tangents_[2].xyz() * barycentric.z);
+    const Vec3f tangent = (interpolated_tangent - vertex_normal * vertex_normal.dot(interpolated_tangent)).normalized();
+    const Vec3f bitangent = vertex_normal.cross(tangent) * tangents_[0].w;
+    return (tangent * surface.normal.x +
+            bitangent * surface.normal.y +
+            vertex_normal * surface.normal.z).normalized();
+}
+
+Vec3f MaterialShader::lit_color(const Vec3f& albedo, const Vec3f& normal, float metalness, float roughness,
+                                const Vec3f& frag_pos) const
+{
+    const Vec3f light_dir = light_.get_direction();
     const Vec3f light_color = light_.get_color();
-    const Vec3f ambient = light_color * ambient_strength_;
+    const Vec3f light_albedo(light_color.x * albedo.x, light_color.y * albedo.y, light_color.z * albedo.z);
 
+    const Vec3f ambient = light_albedo * ambient_strength_;
     const float diff = std::max(0.0f, normal.dot(light_dir));
-    const Vec3f diffuse = light_color * diff * light_.get_intensity();
+    const Vec3f diffuse = light_albedo * (diff * light_.get_intensity() * (1.0f - metalness));
 
-    float specular = 0.0f;
+    Vec3f specular(0.0f, 0.0f, 0.0f);
     if (diff > 0.0f)
     {
+        const float r = std::max(roughness, 0.05f);
+        const float shininess = std::clamp(2.0f / (r * r * r * r) - 2.0f, 1.0f, 256.0f);
         const Vec3f reflect_dir = (normal * (2.0f * normal.dot(light_dir))) - light_dir;
         const Vec3f view_dir = (camera_.get_position() - frag_pos).normalized();
-        const float spec = std::pow(std::max(0.0f, reflect_dir.dot(view_dir)), shininess_);
-        specular = spec * specular_strength_ * light_.get_intensity();
-    }
-
-    Vec3f final_color = ambient + diffuse + Vec3f(specular, specular, specular);
+        const float spec = std::pow(std::max(0.0f, reflect_dir.dot(view_dir)), shininess) *
+            specular_strength_ * light_.get_intensity();
 
-    if (texture_ && texture_->is_valid())
-    {
-        const Vec2f uv = uv_coords_[0] * barycentric.x +
-                         uv_coords_[1] * barycentric.y +
-                         uv_coords_[2] * barycentric.z;
-        const Vec3f tex_color = texture_->sample(uv);
-        final_color.x *= tex_color.x;
-        final_color.y *= tex_color.y;
-        final_color.z *= tex_color.z;
+        const Vec3f dielectric(0.04f, 0.04f, 0.04f);
+        const Vec3f specular_color = dielectric * (1.0f - metalness) + albedo * metalness;
+        specular = Vec3f(specular_color.x * light_color.x,
+                         specular_color.y * light_color.y,
+                         specular_color.z * light_color.z) * spec;
     }
 
-    const unsigned char r = static_cast<unsigned char>(std::clamp(final_color.x, 0.0f, 1.0f) * 255.0f);
-    const unsigned char g = static_cast<unsigned char>(std::clamp(final_color.y, 0.0f, 1.0f) * 255.0f);
-    const unsigned char b = static_cast<unsigned char>(std::clamp(final_color.z, 0.0f, 1.0f) * 255.0f);
-    color = TGAColor(r, g, b, 255);
-    return false;
+    return ambient + diffuse + specular;
 }
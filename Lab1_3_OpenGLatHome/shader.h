@@ -1,21 +1,44 @@
 #pragma once
 
 #include <array>
+#include <span>
+#include <vector>
 
 #include "camera.h"
+#include "fast_math.h"
+#include "gbuffer.h"
 #include "geometry.h"
 #include "light.h"
+#include "light_grid.h"
 #include "libs/tgaimage.h"
+#include "material.h"
 #include "model.h"
+#include "shadow_map.h"
 #include "texture.h"
 
+// Shaders that also implement
+//     void surface(const Vec3f& barycentric, GBufferTexel& texel) const;
+//     Vec3f shade(const GBufferTexel& texel, const Vec2i& pixel) const;
+// can run deferred: surface() records what fragment() would light, and
+// shade() lights it once per visible pixel (see renderer::gbuffer_triangle).
 class IShader
 {
 public:
     virtual ~IShader() = default;
 
-    virtual Vec3f vertex(int face_index, int vertex_index) = 0;
-    virtual bool fragment(const Vec3f& barycentric, TGAColor& color) = 0;
+    // Returns screen x, y, depth and 1/w of the vertex.
+    virtual Vec4f vertex(int face_index, int vertex_index) = 0;
+    // `barycentric` is perspective-corrected and `pixel` is the fragment's
+    // screen position. `color` is linear RGB; the render target clamps and
+    // packs it into its own pixel format.
+    // Returning true from fragment() discards the fragment.
+    virtual bool fragment(const Vec3f& barycentric, const Vec2i& pixel, Vec3f& color) = 0;
+
+    // Whether fragment() may ever discard. Shaders that never do can have
+    // depth tested and written before they run (early Z, see
+    // renderer::barycentric_triangle); the deferred and visibility passes
+    // require it. Defaults to the safe answer.
+    [[nodiscard]] virtual bool may_discard() const { return true; }
 };
 
 class BasicShader : public IShader
@@ -26,8 +49,9 @@ public:
                 const Light& light,
                 const Texture* texture);
 
-    Vec3f vertex(int face_index, int vertex_index) override;
-    bool fragment(const Vec3f& barycentric, TGAColor& color) override;
+    Vec4f vertex(int face_index, int vertex_index) override;
+    bool fragment(const Vec3f& barycentric, const Vec2i& pixel, Vec3f& color) override;
+    [[nodiscard]] bool may_discard() const override { return false; }
 
 private:
     const Model& model_;
@@ -36,10 +60,17 @@ private:
     const Texture* texture_;
 
     std::array<Vec3f, 3> world_coords_;
-    std::array<Vec3f, 3> screen_coords_;
+    std::array<Vec4f, 3> screen_coords_;
     std::array<Vec2f, 3> uv_coords_;
 };
 
+enum class ShadingPrecision
+{
+    Exact,
+    // Table-driven specular power; see fast_math::SpecularTable::max_error().
+    Fast
+};
+
 class PhongShader : public IShader
 {
 public:
@@ -49,23 +80,106 @@ public:
                 const Texture* texture,
                 float ambient_strength = 0.1f,
                 float specular_strength = 0.5f,
-                float shininess = 32.0f);
+                float shininess = 32.0f,
+                ShadingPrecision precision = ShadingPrecision::Exact);
+    // Lights any number of directional, point and spot lights. With a grid
+    // (built for the same lights and camera) each fragment only visits the
+    // lights binned into its screen tile; without one it visits all of them.
+    PhongShader(const Model& model,
+                const Camera& camera,
+                std::span<const Light> lights,
+                const LightGrid* light_grid,
+                const Texture* texture,
+                float ambient_strength = 0.1f,
+                float specular_strength = 0.5f,
+                float shininess = 32.0f,
+                ShadingPrecision precision = ShadingPrecision::Exact);
 
-    Vec3f vertex(int face_index, int vertex_index) override;
-    bool fragment(const Vec3f& barycentric, TGAColor& color) override;
+    Vec4f vertex(int face_index, int vertex_index) override;
+    bool fragment(const Vec3f& barycentric, const Vec2i& pixel, Vec3f& color) override;
+    [[nodiscard]] bool may_discard() const override { return false; }
+
+    void surface(const Vec3f& barycentric, GBufferTexel& texel) const;
+    [[nodiscard]] Vec3f shade(const GBufferTexel& texel, const Vec2i& pixel) const;
+
+    // Shadows lights_[light_index] (a directional light) with `shadow_map`,
+    // which must have been rendered for it. nullptr turns shadows off.
+    void set_shadow_map(const ShadowMap* shadow_map, size_t light_index = 0);
+
+    // Worst case over every light at its Light::max_intensity(), so point and
+    // spot lights count at their clamped closest distance.
+    [[nodiscard]] float specular_error_bound() const;
 
 private:
+    [[nodiscard]] Vec3f lit_color(const Vec3f& normal, const Vec3f& frag_pos, const Vec2f& uv,
+                                  const Vec2i& pixel) const;
+    void add_light(size_t index, const Vec3f& normal, const Vec3f& frag_pos,
+                   Vec3f& diffuse, float& specular) const;
+
     const Model& model_;
     const Camera& camera_;
-    const Light& light_;
+    std::span<const Light> lights_;
+    const LightGrid* light_grid_;
     const Texture* texture_;
+    const ShadowMap* shadow_map_ = nullptr;
+    size_t shadow_light_ = 0;
 
+    // Directional lights only; point and spot lights add no ambient term.
+    Vec3f ambient_;
     float ambient_strength_;
     float specular_strength_;
     float shininess_;
+    const fast_math::SpecularTable* specular_table_;
+
+    std::array<Vec3f, 3> world_coords_;
+    std::array<Vec4f, 3> screen_coords_;
+    std::array<Vec2f, 3> uv_coords_;
+    std::array<Vec3f, 3> normals_;
+};
+
+// Phong lighting driven by the model's MTL materials: albedo from map_Kd, and
+// normal/metalness/roughness from the material's packed SurfaceMap.
+class MaterialShader : public IShader
+{
+public:
+    MaterialShader(const Model& model,
+                   const Camera& camera,
+                   const Light& light,
+                   const MaterialSet& materials,
+                   float ambient_strength = 0.1f,
+                   float specular_strength = 0.5f);
+
+    Vec4f vertex(int face_index, int vertex_index) override;
+    bool fragment(const Vec3f& barycentric, const Vec2i& pixel, Vec3f& color) override;
+    [[nodiscard]] bool may_discard() const override { return false; }
+
+    // Stores the normal-mapped normal, material index, metalness and
+    // roughness; shade() only samples the albedo map.
+    void surface(const Vec3f& barycentric, GBufferTexel& texel) const;
+    [[nodiscard]] Vec3f shade(const GBufferTexel& texel, const Vec2i& pixel) const;
+
+private:
+    static Vec3f albedo(const Material* material, const MaterialTextures* textures, const Vec2f& uv);
+    [[nodiscard]] Vec3f surface_normal(const Vec3f& barycentric, const Vec2f& uv,
+                                       float& metalness, float& roughness) const;
+    [[nodiscard]] Vec3f lit_color(const Vec3f& albedo, const Vec3f& normal, float metalness, float roughness,
+                                  const Vec3f& frag_pos) const;
+
+    const Model& model_;
+    const Camera& camera_;
+    const Light& light_;
+    const MaterialSet& materials_;
+
+    float ambient_strength_;
+    float specular_strength_;
+
+    int material_index_ = -1;
+    const Material* material_ = nullptr;
+    const MaterialTextures* textures_ = nullptr;
 
     std::array<Vec3f, 3> world_coords_;
-    std::array<Vec3f, 3> screen_coords_;
+    std::array<Vec4f, 3> screen_coords_;
     std::array<Vec2f, 3> uv_coords_;
     std::array<Vec3f, 3> normals_;
+    std::array<Vec4f, 3> tangents_;
 };
@@ -0,0 +1,111 @@
+#include "shadow_map.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "renderer.h"
+#include "trace.h"
+
+namespace
+{
+    // Grazing angles would otherwise ask for an unbounded slope bias.
+    constexpr float kMaxSlope = 10.0f;
+}
+
+ShadowMap::ShadowMap(int size, int pcf_radius, float bias_texels)
+    : size_(size),
+      pcf_radius_(std::max(0, pcf_radius)),
+      bias_texels_(bias_texels),
+      depth_(size, size)
+{
+}
+
+Vec4f ShadowMap::project(const Vec3f& point) const
+{
+    const Vec3f offset = point - center_;
+    const float scale = 0.5f * static_cast<float>(size_) / radius_;
+    return {
+        (offset.dot(right_) + radius_) * scale,
+        (offset.dot(up_) + radius_) * scale,
+        0.5f - 0.5f * offset.dot(forward_) / radius_,
+        1.0f
+    };
+}
+
+void ShadowMap::render(const Model& model, const Light& light)
+{
+    const trace::Scope scope("shadow map");
+    if (light.get_type() != LightType::Directional)
+    {
+        throw std::runtime_error("ShadowMap only supports directional lights");
+    }
+
+    forward_ = light.get_direction();
+    const Vec3f world_up = std::abs(forward_.y) < 0.99f ? Vec3f(0.0f, 1.0f, 0.0f) : Vec3f(1.0f, 0.0f, 0.0f);
+    right_ = world_up.cross(forward_).normalized();
+    up_ = forward_.cross(right_);
+
+    Vec3f min_corner(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                     std::numeric_limits<float>::max());
+    Vec3f max_corner(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(),
+                     std::numeric_limits<float>::lowest());
+    for (int i = 0; i < static_cast<int>(model.nverts()); ++i)
+    {
+        const Vec3f& v = model.vert(i);
+        min_corner = Vec3f(std::min(min_corner.x, v.x), std::min(min_corner.y, v.y), std::min(min_corner.z, v.z));
+        max_corner = Vec3f(std::max(max_corner.x, v.x), std::max(max_corner.y, v.y), std::max(max_corner.z, v.z));
+    }
+    center_ = (min_corner + max_corner) * 0.5f;
+    // Slightly padded so silhouettes do not touch the border texels.
+    radius_ = std::max((max_corner - min_corner).length() * 0.5f * 1.01f, 1e-6f);
+
+    projected_.resize(model.nverts());
+    for (size_t i = 0; i < projected_.size(); ++i)
+    {
+        projected_[i] = project(model.vert(static_cast<int>(i)));
+    }
+
+    depth_.clear();
+    for (int face_index = 0; face_index < static_cast<int>(model.nfaces()); ++face_index)
+    {
+        const std::vector<int>& face = model.face(face_index);
+        renderer::depth_triangle(std::array<Vec4f, 3>{projected_[face[0]], projected_[face[1]], projected_[face[2]]},
+                                 depth_);
+    }
+    depth_.resolve(texels_);
+}
+
+float ShadowMap::visibility(const Vec3f& point, const Vec3f& normal) const
+{
+    // Low-poly silhouettes disagree with interpolated normals, so besides the
+    // depth bias the lookup moves off the surface, more so at grazing angles.
+    const float cos_clamped = std::clamp(normal.dot(forward_), 1e-3f, 1.0f);
+    const float texel = 2.0f * radius_ / static_cast<float>(size_);
+    const Vec4f projected = project(point - normal * (bias_texels_ * texel * (1.0f - cos_clamped)));
+    const int center_x = static_cast<int>(std::floor(projected.x));
+    const int center_y = static_cast<int>(std::floor(projected.y));
+    if (center_x < 0 || center_y < 0 || center_x >= size_ || center_y >= size_)
+    {
+        return 1.0f;
+    }
+
+    // One texel spans 1/size_ in depth units; scale that by the surface slope.
+    const float slope = std::min(std::sqrt(1.0f - cos_clamped * cos_clamped) / cos_clamped, kMaxSlope);
+    const float depth = projected.z + bias_texels_ * (1.0f + slope) / static_cast<float>(size_);
+
+    int lit = 0;
+    int taps = 0;
+    for (int y = center_y - pcf_radius_; y <= center_y + pcf_radius_; ++y)
+    {
+        const float* row = texels_.data() + static_cast<size_t>(std::clamp(y, 0, size_ - 1)) * size_;
+        for (int x = center_x - pcf_radius_; x <= center_x + pcf_radius_; ++x, ++taps)
+        {
+            // Never-written texels hold lowest() and so always pass.
+            lit += depth >= row[std::clamp(x, 0, size_ - 1)] ? 1 : 0;
+        }
+    }
+    return static_cast<float>(lit) / static_cast<float>(taps);
+}
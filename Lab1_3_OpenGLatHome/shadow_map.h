@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+
+#include "depth_buffer.h"
+#include "geometry.h"
+#include "light.h"
+#include "model.h"
+
+// Scene depth as seen from a directional light, through an orthographic
+// projection fitted around the model's bounds. Rendered with the depth-only
+// rasterizer path (each model vertex is projected once, no shader runs) and
+// sampled with percentage-closer filtering over a (2r+1)^2 texel footprint.
+class ShadowMap
+{
+public:
+    // `pcf_radius` 0 gives hard shadows. Lookups are pushed `bias_texels`
+    // texels off the surface, along the normal and in depth scaled by the
+    // slope, which keeps lit surfaces from shadowing themselves.
+    explicit ShadowMap(int size, int pcf_radius = 1, float bias_texels = 1.5f);
+
+    // Throws std::runtime_error for point and spot lights.
+    void render(const Model& model, const Light& light);
+
+    // Fraction of the light that reaches `point`, in [0, 1]. `normal` is the
+    // shading normal, oriented like the light direction on lit surfaces (as
+    // in the diffuse term). Points outside the map are lit.
+    [[nodiscard]] float visibility(const Vec3f& point, const Vec3f& normal) const;
+
+    [[nodiscard]] int size() const { return size_; }
+    [[nodiscard]] int pcf_radius() const { return pcf_radius_; }
+
+private:
+    // Map x, y in texels and depth in [0, 1] (1 nearest the light).
+    [[nodiscard]] Vec4f project(const Vec3f& point) const;
+
+    int size_;
+    int pcf_radius_;
+    float bias_texels_;
+
+    Vec3f center_;
+    Vec3f right_;
+    Vec3f up_;
+    Vec3f forward_;
+    float radius_ = 1.0f;
+
+    DepthBuffer<DepthFormat::Float32> depth_;
+    std::vector<Vec4f> projected_;
+    // Row-major copy of depth_ for sampling.
+    std::vector<float> texels_;
+};
@@ -1,13 +1,32 @@
 #include "texture.h"
 
+#include "block_compression.h"
+#include "fast_math.h"
+#define STB_IMAGE_IMPLEMENTATION
 #include "libs/stb_image.h"
+#include "trace.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cmath>
 #include <stdexcept>
 
 namespace
 {
+    std::atomic<uint32_t> next_texture_serial{1};
+
+    // Small direct-mapped cache of decoded BC1 blocks, one per sampling thread.
+    struct DecodedBlock
+    {
+        uint32_t serial = 0;
+        const unsigned char* block = nullptr;
+        unsigned char rgb[16 * 3];
+    };
+
+    constexpr size_t kDecodedBlockSlots = 64;
+    thread_local std::array<DecodedBlock, kDecodedBlockSlots> decoded_blocks;
+
     float wrap_coord(float value)
     {
         float wrapped = std::fmod(value, 1.0f);
@@ -17,12 +36,67 @@ namespace
         }
         return wrapped;
     }
+
+    void downsample_box(const unsigned char* src, int src_width, int src_height,
+                        unsigned char* dst, int dst_width, int dst_height, int channels)
+    {
+        for (int y = 0; y < dst_height; ++y)
+        {
+            const int y0 = std::min(y * 2, src_height - 1);
+            const int y1 = std::min(y * 2 + 1, src_height - 1);
+            for (int x = 0; x < dst_width; ++x)
+            {
+                const int x0 = std::min(x * 2, src_width - 1);
+                const int x1 = std::min(x * 2 + 1, src_width - 1);
+                for (int c = 0; c < channels; ++c)
+                {
+                    const int sum = src[(x0 + y0 * src_width) * channels + c] +
+                        src[(x1 + y0 * src_width) * channels + c] +
+                        src[(x0 + y1 * src_width) * channels + c] +
+                        src[(x1 + y1 * src_width) * channels + c];
+                    dst[(x + y * dst_width) * channels + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+    }
 }
 
-Texture::Texture(const std::string& path)
+Texture::Texture(const std::string& path, const TextureOptions& options)
     : width_(0),
       height_(0),
-      channels_(3)
+      channels_(3),
+      format_(TextureFormat::RGB8),
+      serial_(next_texture_serial.fetch_add(1, std::memory_order_relaxed))
+{
+    const trace::Scope scope("load texture");
+    if (options.use_cache)
+    {
+        std::optional<CachedTexture> cached = texture_cache::load(path, options.format, options.generate_mips);
+        if (cached)
+        {
+            width_ = cached->levels.front().width;
+            height_ = cached->levels.front().height;
+            format_ = cached->format;
+            levels_ = std::move(cached->levels);
+            texels_ = cached->texels;
+            mapping_ = std::move(cached->file);
+            return;
+        }
+    }
+
+    decode(path, options);
+    if (options.format == TextureFormat::BC1)
+    {
+        compress_bc1();
+    }
+
+    if (options.use_cache)
+    {
+        texture_cache::store(path, format_, options.generate_mips, levels_, data_.data(), data_.size());
+    }
+}
+
+void Texture::decode(const std::string& path, const TextureOptions& options)
 {
     int width = 0;
     int height = 0;
@@ -36,14 +110,93 @@ Texture::Texture(const std::string& path)
     width_ = width;
     height_ = height;
     channels_ = 3;
-    const size_t pixel_count = width_ * height_ * channels_;
-    data_.assign(pixels, pixels + pixel_count);
+
+    levels_.push_back({width_, height_, 0});
+    if (options.generate_mips)
+    {
+        while (levels_.back().width > 1 || levels_.back().height > 1)
+        {
+            const TextureMipLevel& last = levels_.back();
+            const size_t offset = last.offset + static_cast<size_t>(last.width) * last.height * channels_;
+            levels_.push_back({std::max(1, last.width / 2), std::max(1, last.height / 2), offset});
+        }
+    }
+
+    const TextureMipLevel& smallest = levels_.back();
+    data_.resize(smallest.offset + static_cast<size_t>(smallest.width) * smallest.height * channels_);
+
+    const size_t pixel_count = static_cast<size_t>(width_) * height_ * channels_;
+    std::copy(pixels, pixels + pixel_count, data_.begin());
     stbi_image_free(pixels);
+
+    for (size_t i = 1; i < levels_.size(); ++i)
+    {
+        const TextureMipLevel& src = levels_[i - 1];
+        const TextureMipLevel& dst = levels_[i];
+        downsample_box(data_.data() + src.offset, src.width, src.height,
+                       data_.data() + dst.offset, dst.width, dst.height, channels_);
+    }
+
+    texels_ = data_.data();
+}
+
+void Texture::compress_bc1()
+{
+    std::vector<TextureMipLevel> levels;
+    levels.reserve(levels_.size());
+    size_t offset = 0;
+    for (const TextureMipLevel& level : levels_)
+    {
+        levels.push_back({level.width, level.height, offset});
+        offset += bc1::level_bytes(level.width, level.height);
+    }
+
+    std::vector<unsigned char> blocks(offset);
+    for (size_t i = 0; i < levels_.size(); ++i)
+    {
+        bc1::encode_image(data_.data() + levels_[i].offset, levels_[i].width, levels_[i].height,
+                          blocks.data() + levels[i].offset);
+    }
+
+    levels_ = std::move(levels);
+    data_ = std::move(blocks);
+    texels_ = data_.data();
+    format_ = TextureFormat::BC1;
+}
+
+const unsigned char* Texture::fetch_bc1(const TextureMipLevel& mip, int x, int y) const
+{
+    const int block_x = x / bc1::kBlockSize;
+    const int block_y = y / bc1::kBlockSize;
+    const unsigned char* block = texels_ + mip.offset +
+        (block_x + block_y * bc1::blocks_across(mip.width)) * bc1::kBlockBytes;
+
+    DecodedBlock& slot = decoded_blocks[(reinterpret_cast<uintptr_t>(block) / bc1::kBlockBytes) % kDecodedBlockSlots];
+    if (slot.block != block || slot.serial != serial_)
+    {
+        bc1::decode_block(block, slot.rgb);
+        slot.block = block;
+        slot.serial = serial_;
+    }
+
+    const int texel = (x % bc1::kBlockSize) + (y % bc1::kBlockSize) * bc1::kBlockSize;
+    return slot.rgb + texel * 3;
 }
 
 Vec3f Texture::sample(const Vec2f& uv) const
 {
-    if (data_.empty() || width_ == 0 || height_ == 0)
+    return sample_level(uv, 0);
+}
+
+Vec3f Texture::sample_level(const Vec2f& uv, int level) const
+{
+    if (!texels_ || levels_.empty())
+    {
+        return Vec3f(1.0f, 1.0f, 1.0f);
+    }
+
+    const TextureMipLevel& mip = levels_[std::clamp(level, 0, mip_count() - 1)];
+    if (mip.width == 0 || mip.height == 0)
     {
         return Vec3f(1.0f, 1.0f, 1.0f);
     }
@@ -51,12 +204,13 @@ Vec3f Texture::sample(const Vec2f& uv) const
     const float u = wrap_coord(uv.x);
     const float v = wrap_coord(uv.y);
 
-    const int x = std::clamp(static_cast<int>(u * width_), 0, width_ - 1);
-    const int y = std::clamp(static_cast<int>((1.0f - v) * height_), 0, height_ - 1);
+    const int x = std::clamp(static_cast<int>(u * mip.width), 0, mip.width - 1);
+    const int y = std::clamp(static_cast<int>((1.0f - v) * mip.height), 0, mip.height - 1);
 
-    const int index = (x + y * width_) * channels_;
-    const float r = data_.at(index) / 255.0f;
-    const float g = data_.at(index + 1) / 255.0f;
-    const float b = data_.at(index + 2) / 255.0f;
-    return Vec3f(r, g, b);
+    const unsigned char* texel = (format_ == TextureFormat::BC1)
+                                     ? fetch_bc1(mip, x, y)
+                                     : texels_ + mip.offset + (x + y * mip.width) * channels_;
+    return Vec3f(fast_math::kByteToFloat[texel[0]],
+                 fast_math::kByteToFloat[texel[1]],
+                 fast_math::kByteToFloat[texel[2]]);
 }
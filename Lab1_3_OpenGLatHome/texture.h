@@ -1,22 +1,50 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "geometry.h"
+#include "texture_cache.h"
+
+struct TextureOptions
+{
+    // Keep decoded texels in "<image>.<rgb8|bc1>.texcache" and map them on later runs.
+    bool use_cache = true;
+    bool generate_mips = true;
+    // BC1 keeps 4x4 blocks in 8 bytes instead of 48; blocks are decoded on demand.
+    TextureFormat format = TextureFormat::RGB8;
+};
 
 class Texture
 {
 public:
-    explicit Texture(const std::string& path);
+    explicit Texture(const std::string& path, const TextureOptions& options = {});
     ~Texture() = default;
 
-    [[nodiscard]] bool is_valid() const { return !data_.empty(); }
+    [[nodiscard]] bool is_valid() const { return texels_ != nullptr; }
+    [[nodiscard]] bool loaded_from_cache() const { return mapping_ != nullptr; }
+    [[nodiscard]] int width() const { return width_; }
+    [[nodiscard]] int height() const { return height_; }
+    [[nodiscard]] int mip_count() const { return static_cast<int>(levels_.size()); }
+    [[nodiscard]] TextureFormat format() const { return format_; }
+
     [[nodiscard]] Vec3f sample(const Vec2f& uv) const;
+    [[nodiscard]] Vec3f sample_level(const Vec2f& uv, int level) const;
 
 private:
+    void decode(const std::string& path, const TextureOptions& options);
+    void compress_bc1();
+    [[nodiscard]] const unsigned char* fetch_bc1(const TextureMipLevel& mip, int x, int y) const;
+
     int width_;
     int height_;
     int channels_;
+    TextureFormat format_;
+    uint32_t serial_;
+
+    const unsigned char* texels_ = nullptr;
+    std::vector<TextureMipLevel> levels_;
     std::vector<unsigned char> data_;
+    std::unique_ptr<MappedFile> mapping_;
 };
@@ -0,0 +1,280 @@
+#include "texture_cache.h"
+
+#include "block_compression.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <system_error>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr char kMagic[8] = {'T', 'E', 'X', 'C', 'A', 'C', 'H', 'E'};
+    constexpr uint32_t kVersion = 3;
+    // CacheHeader::flags
+    constexpr uint32_t kFlagMipmapped = 1;
+    constexpr size_t kDataAlignment = 64;
+
+    struct CacheHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t format;
+        uint64_t source_size;
+        int64_t source_mtime;
+        uint32_t level_count;
+        uint32_t flags;
+        uint64_t data_offset;
+        uint64_t data_size;
+    };
+
+    struct CacheLevel
+    {
+        uint32_t width;
+        uint32_t height;
+        uint64_t offset;
+    };
+
+    struct SourceStamp
+    {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+    };
+
+    std::optional<SourceStamp> stamp_of(const String& path)
+    {
+        std::error_code error;
+        const auto size = std::filesystem::file_size(path, error);
+        if (error)
+        {
+            return std::nullopt;
+        }
+        const auto mtime = std::filesystem::last_write_time(path, error);
+        if (error)
+        {
+            return std::nullopt;
+        }
+        return SourceStamp{static_cast<uint64_t>(size), static_cast<int64_t>(mtime.time_since_epoch().count())};
+    }
+
+    size_t align_up(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+size_t texture_level_bytes(TextureFormat format, int width, int height)
+{
+    switch (format)
+    {
+    case TextureFormat::BC1:
+        return bc1::level_bytes(width, height);
+    case TextureFormat::RGB8:
+    default:
+        return static_cast<size_t>(width) * height * 3;
+    }
+}
+
+std::unique_ptr<MappedFile> MappedFile::open(const String& path)
+{
+    std::unique_ptr<MappedFile> file(new MappedFile());
+
+#ifndef _WIN32
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+
+    struct stat info{};
+    if (::fstat(fd, &info) != 0 || info.st_size <= 0)
+    {
+        ::close(fd);
+        return nullptr;
+    }
+
+    void* mapping = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    file->data_ = static_cast<const unsigned char*>(mapping);
+    file->size_ = static_cast<size_t>(info.st_size);
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+    {
+        return nullptr;
+    }
+
+    const std::streamsize size = in.tellg();
+    if (size <= 0)
+    {
+        return nullptr;
+    }
+
+    file->fallback_.resize(static_cast<size_t>(size));
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char*>(file->fallback_.data()), size))
+    {
+        return nullptr;
+    }
+
+    file->data_ = file->fallback_.data();
+    file->size_ = file->fallback_.size();
+#endif
+
+    return file;
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+    if (data_ && fallback_.empty())
+    {
+        ::munmap(const_cast<unsigned char*>(data_), size_);
+    }
+#endif
+}
+
+namespace texture_cache
+{
+    String cache_path_for(const String& source_path, TextureFormat format)
+    {
+        return source_path + (format == TextureFormat::BC1 ? ".bc1" : ".rgb8") + ".texcache";
+    }
+
+    std::optional<CachedTexture> load(const String& source_path, TextureFormat format, bool mipmapped)
+    {
+        const std::optional<SourceStamp> stamp = stamp_of(source_path);
+        if (!stamp)
+        {
+            return std::nullopt;
+        }
+
+        std::unique_ptr<MappedFile> file = MappedFile::open(cache_path_for(source_path, format));
+        if (!file || file->size() < sizeof(CacheHeader))
+        {
+            return std::nullopt;
+        }
+
+        CacheHeader header{};
+        std::memcpy(&header, file->data(), sizeof(header));
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+            header.version != kVersion ||
+            header.source_size != stamp->size ||
+            header.source_mtime != stamp->mtime ||
+            header.level_count == 0 ||
+            header.format != static_cast<uint32_t>(format) ||
+            (header.flags & kFlagMipmapped) != (mipmapped ? kFlagMipmapped : 0))
+        {
+            return std::nullopt;
+        }
+
+        const size_t levels_end = sizeof(CacheHeader) + header.level_count * sizeof(CacheLevel);
+        if (levels_end > header.data_offset || header.data_offset + header.data_size > file->size())
+        {
+            return std::nullopt;
+        }
+
+        CachedTexture cached;
+        cached.format = static_cast<TextureFormat>(header.format);
+        cached.levels.reserve(header.level_count);
+        for (uint32_t i = 0; i < header.level_count; ++i)
+        {
+            CacheLevel level{};
+            std::memcpy(&level, file->data() + sizeof(CacheHeader) + i * sizeof(CacheLevel), sizeof(level));
+            const uint64_t level_bytes = texture_level_bytes(cached.format, static_cast<int>(level.width),
+                                                             static_cast<int>(level.height));
+            if (level.offset + level_bytes > header.data_size)
+            {
+                return std::nullopt;
+            }
+            cached.levels.push_back({static_cast<int>(level.width), static_cast<int>(level.height),
+                                     static_cast<size_t>(level.offset)});
+        }
+
+        cached.texels = file->data() + header.data_offset;
+        cached.texel_bytes = static_cast<size_t>(header.data_size);
+        cached.file = std::move(file);
+        return cached;
+    }
+
+    bool store(const String& source_path,
+               TextureFormat format,
+               bool mipmapped,
+               const std::vector<TextureMipLevel>& levels,
+               const unsigned char* texels,
+               size_t texel_bytes)
+    {
+        const std::optional<SourceStamp> stamp = stamp_of(source_path);
+        if (!stamp || levels.empty())
+        {
+            return false;
+        }
+
+        CacheHeader header{};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.format = static_cast<uint32_t>(format);
+        header.source_size = stamp->size;
+        header.source_mtime = stamp->mtime;
+        header.level_count = static_cast<uint32_t>(levels.size());
+        header.flags = mipmapped ? kFlagMipmapped : 0;
+        header.data_offset = align_up(sizeof(CacheHeader) + levels.size() * sizeof(CacheLevel), kDataAlignment);
+        header.data_size = texel_bytes;
+
+        const String cache_path = cache_path_for(source_path, format);
+        // Unique per writer, so processes warming the same asset never share
+        // a temp file; the last rename wins with a complete file either way.
+        const String temp_path = cache_path + "." + std::to_string(std::random_device{}()) + ".tmp";
+        {
+            std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+            if (!out)
+            {
+                std::cerr << "can't create texture cache " << temp_path << "\n";
+                return false;
+            }
+
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (const TextureMipLevel& level : levels)
+            {
+                const CacheLevel stored{static_cast<uint32_t>(level.width), static_cast<uint32_t>(level.height),
+                                        static_cast<uint64_t>(level.offset)};
+                out.write(reinterpret_cast<const char*>(&stored), sizeof(stored));
+            }
+
+            const std::vector<char> padding(header.data_offset - sizeof(CacheHeader) - levels.size() * sizeof(CacheLevel), 0);
+            out.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+            out.write(reinterpret_cast<const char*>(texels), static_cast<std::streamsize>(texel_bytes));
+            if (!out.good())
+            {
+                std::cerr << "can't write texture cache " << temp_path << "\n";
+                out.close();
+                std::filesystem::remove(temp_path);
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temp_path, cache_path, error);
+        if (error)
+        {
+            std::cerr << "can't replace texture cache " << cache_path << ": " << error.message() << "\n";
+            std::filesystem::remove(temp_path, error);
+            return false;
+        }
+        return true;
+    }
+}
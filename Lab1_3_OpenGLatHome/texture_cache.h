@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "geometry.h"
+
+// Read-only view of a whole file; memory-mapped where the platform allows it.
+class MappedFile
+{
+public:
+    static std::unique_ptr<MappedFile> open(const String& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    [[nodiscard]] const unsigned char* data() const { return data_; }
+    [[nodiscard]] size_t size() const { return size_; }
+
+private:
+    MappedFile() = default;
+
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+    std::vector<unsigned char> fallback_;
+};
+
+enum class TextureFormat : uint32_t
+{
+    RGB8 = 0,
+    BC1 = 1
+};
+
+size_t texture_level_bytes(TextureFormat format, int width, int height);
+
+struct TextureMipLevel
+{
+    int width = 0;
+    int height = 0;
+    size_t offset = 0;
+};
+
+// Decoded texel data (all mip levels packed back to back) as stored in a cache file.
+struct CachedTexture
+{
+    std::unique_ptr<MappedFile> file;
+    const unsigned char* texels = nullptr;
+    size_t texel_bytes = 0;
+    TextureFormat format = TextureFormat::RGB8;
+    std::vector<TextureMipLevel> levels;
+};
+
+namespace texture_cache
+{
+    // "<image>.<rgb8|bc1>.texcache": each format has its own file, so loading
+    // one format never evicts the other.
+    String cache_path_for(const String& source_path, TextureFormat format);
+
+    // Returns the cached texels if a cache file for `format` exists next to
+    // the source, still matches its size and modification time, and was
+    // stored with (or without) a mip chain as `mipmapped` asks.
+    std::optional<CachedTexture> load(const String& source_path, TextureFormat format, bool mipmapped);
+
+    bool store(const String& source_path,
+               TextureFormat format,
+               bool mipmapped,
+               const std::vector<TextureMipLevel>& levels,
+               const unsigned char* texels,
+               size_t texel_bytes);
+}
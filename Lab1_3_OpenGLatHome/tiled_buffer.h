@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Per-pixel storage in 8x8 tiles with a "cleared" flag per tile, like
+// DepthBuffer: clear() only sets the flags, and a tile is filled with T{} the
+// first time a pixel in it is written, so a clear costs O(tiles).
+template <typename T>
+class TiledBuffer
+{
+public:
+    static constexpr int kTileSize = 8;
+    static constexpr int kTileArea = kTileSize * kTileSize;
+
+    TiledBuffer(int width, int height)
+        : width_(width),
+          height_(height),
+          tiles_x_((width + kTileSize - 1) / kTileSize),
+          tiles_y_((height + kTileSize - 1) / kTileSize),
+          values_(static_cast<size_t>(tiles_x_) * tiles_y_ * kTileArea),
+          cleared_(static_cast<size_t>(tiles_x_) * tiles_y_, 1)
+    {
+    }
+
+    [[nodiscard]] int width() const { return width_; }
+    [[nodiscard]] int height() const { return height_; }
+    [[nodiscard]] int tiles_x() const { return tiles_x_; }
+    [[nodiscard]] int tiles_y() const { return tiles_y_; }
+
+    void clear()
+    {
+        std::fill(cleared_.begin(), cleared_.end(), uint8_t{1});
+    }
+
+    [[nodiscard]] bool tile_cleared(int tile_x, int tile_y) const
+    {
+        return cleared_[static_cast<size_t>(tile_y) * tiles_x_ + tile_x] != 0;
+    }
+
+    void store(int x, int y, const T& value)
+    {
+        const size_t tile = tile_index(x, y);
+        T* values = values_.data() + tile * kTileArea;
+        if (cleared_[tile])
+        {
+            std::fill_n(values, kTileArea, T{});
+            cleared_[tile] = 0;
+        }
+        values[offset_in_tile(x, y)] = value;
+    }
+
+    // Only meaningful in tiles that are not cleared.
+    [[nodiscard]] const T& at(int x, int y) const
+    {
+        return values_[tile_index(x, y) * kTileArea + offset_in_tile(x, y)];
+    }
+
+private:
+    [[nodiscard]] size_t tile_index(int x, int y) const
+    {
+        return static_cast<size_t>(y / kTileSize) * tiles_x_ + x / kTileSize;
+    }
+
+    static int offset_in_tile(int x, int y)
+    {
+        return (y % kTileSize) * kTileSize + x % kTileSize;
+    }
+
+    int width_;
+    int height_;
+    int tiles_x_;
+    int tiles_y_;
+    std::vector<T> values_;
+    std::vector<uint8_t> cleared_;
+};
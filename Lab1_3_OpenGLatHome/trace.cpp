@@ -0,0 +1,209 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    struct Event
+    {
+        const char* name;
+        int64_t start_ns;
+        int64_t duration_ns;
+    };
+
+    struct ThreadLog
+    {
+        unsigned id = 0;
+        String name;
+        std::vector<Event> events;
+    };
+
+    std::atomic<bool> tracing{false};
+    std::chrono::steady_clock::time_point epoch;
+
+    // Logs outlive their threads so that encoder and band threads that have
+    // already exited still show up in the output.
+    std::mutex registry_mutex;
+    std::vector<std::unique_ptr<ThreadLog>> registry;
+    thread_local ThreadLog* thread_log = nullptr;
+
+    ThreadLog& local_log()
+    {
+        if (!thread_log)
+        {
+            auto log = std::make_unique<ThreadLog>();
+            log->events.reserve(1024);
+            const std::lock_guard<std::mutex> lock(registry_mutex);
+            log->id = static_cast<unsigned>(registry.size());
+            log->name = "thread " + std::to_string(log->id);
+            thread_log = log.get();
+            registry.push_back(std::move(log));
+        }
+        return *thread_log;
+    }
+
+    int64_t nanoseconds_since_epoch(std::chrono::steady_clock::time_point time)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time - epoch).count();
+    }
+
+    void write_json_string(std::ostream& out, std::string_view text)
+    {
+        out << '"';
+        for (const char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out << '\\';
+            }
+            out << (static_cast<unsigned char>(c) < 0x20 ? ' ' : c);
+        }
+        out << '"';
+    }
+
+    // Trace timestamps are microseconds; keep the nanoseconds as decimals.
+    void write_microseconds(std::ostream& out, int64_t nanoseconds)
+    {
+        out << nanoseconds / 1000 << '.' << static_cast<char>('0' + nanoseconds / 100 % 10)
+            << static_cast<char>('0' + nanoseconds / 10 % 10) << static_cast<char>('0' + nanoseconds % 10);
+    }
+}
+
+namespace trace
+{
+    void enable()
+    {
+        if (!tracing.load(std::memory_order_relaxed))
+        {
+            epoch = std::chrono::steady_clock::now();
+            tracing.store(true, std::memory_order_release);
+        }
+    }
+
+    bool enabled()
+    {
+        return tracing.load(std::memory_order_relaxed);
+    }
+
+    void set_thread_name(const String& name)
+    {
+        if (enabled())
+        {
+            local_log().name = name;
+        }
+    }
+
+    Scope::Scope(const char* name)
+        : name_(enabled() ? name : nullptr)
+    {
+        if (name_)
+        {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    Scope::~Scope()
+    {
+        if (!name_)
+        {
+            return;
+        }
+        const auto end = std::chrono::steady_clock::now();
+        local_log().events.push_back({name_, nanoseconds_since_epoch(start_),
+                                      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start_).count()});
+    }
+
+    std::vector<StageTotal> stage_totals()
+    {
+        std::vector<StageTotal> stages;
+        const std::lock_guard<std::mutex> lock(registry_mutex);
+        for (const std::unique_ptr<ThreadLog>& log : registry)
+        {
+            for (const Event& event : log->events)
+            {
+                auto stage = std::find_if(stages.begin(), stages.end(), [&](const StageTotal& s)
+                {
+                    return s.name == event.name;
+                });
+                if (stage == stages.end())
+                {
+                    stages.push_back({event.name});
+                    stage = stages.end() - 1;
+                }
+                stage->total_ms += static_cast<double>(event.duration_ns) / 1e6;
+                ++stage->count;
+            }
+        }
+
+        std::sort(stages.begin(), stages.end(), [](const StageTotal& a, const StageTotal& b)
+        {
+            return a.total_ms > b.total_ms;
+        });
+        return stages;
+    }
+
+    void reset()
+    {
+        const std::lock_guard<std::mutex> lock(registry_mutex);
+        for (const std::unique_ptr<ThreadLog>& log : registry)
+        {
+            log->events.clear();
+        }
+    }
+
+    void print_summary(std::ostream& out)
+    {
+        for (const StageTotal& stage : stage_totals())
+        {
+            out << "# time " << stage.name << ": " << stage.total_ms << " ms over " << stage.count << " (mean "
+                << stage.total_ms / static_cast<double>(stage.count) << " ms)\n";
+        }
+        out << std::flush;
+    }
+
+    void write_chrome_json(const String& path)
+    {
+        std::ofstream out(path, std::ios::binary);
+        if (!out)
+        {
+            throw std::runtime_error("Failed to open trace file: " + path);
+        }
+
+        const std::lock_guard<std::mutex> lock(registry_mutex);
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        for (const std::unique_ptr<ThreadLog>& log : registry)
+        {
+            out << (first ? "\n" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << log->id
+                << ",\"args\":{\"name\":";
+            write_json_string(out, log->name);
+            out << "}}";
+            first = false;
+
+            for (const Event& event : log->events)
+            {
+                out << ",\n{\"ph\":\"X\",\"cat\":\"render\",\"name\":";
+                write_json_string(out, event.name);
+                out << ",\"pid\":1,\"tid\":" << log->id << ",\"ts\":";
+                write_microseconds(out, event.start_ns);
+                out << ",\"dur\":";
+                write_microseconds(out, event.duration_ns);
+                out << '}';
+            }
+        }
+        out << "\n]}\n";
+
+        if (!out)
+        {
+            throw std::runtime_error("Failed to write trace file: " + path);
+        }
+    }
+}
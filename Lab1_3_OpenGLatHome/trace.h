@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+#include "geometry.h"
+
+// Wall-clock timers for the pipeline stages (load, vertex processing,
+// binning, rasterization, shading, encoding, file I/O). Off by default, so a
+// Scope costs one relaxed load; once enabled every thread appends to its own
+// event log without locking. The logs can be summed per stage or written as
+// a Chrome / Perfetto trace.
+namespace trace
+{
+    void enable();
+    bool enabled();
+
+    // Labels the calling thread's track in the trace. Ignored while disabled.
+    void set_thread_name(const String& name);
+
+    // Times its own lifetime as one event. `name` must outlive the program
+    // (a string literal).
+    class Scope
+    {
+    public:
+        explicit Scope(const char* name);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* name_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    struct StageTotal
+    {
+        std::string_view name;
+        double total_ms = 0.0;
+        uint64_t count = 0;
+    };
+
+    // These read or clear every thread's log, so the threads that recorded
+    // events must have finished (or at least stopped recording).
+    // Summed over all threads, longest total first.
+    std::vector<StageTotal> stage_totals();
+    // Drops the recorded events but keeps the thread names.
+    void reset();
+    // Total, count and mean per stage, one "# time" line each.
+    void print_summary(std::ostream& out);
+    // Trace Event Format JSON, loadable in chrome://tracing and Perfetto.
+    // Throws std::runtime_error when the file cannot be written.
+    void write_chrome_json(const String& path);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+#include "tiled_buffer.h"
+
+// Which triangle is visible at each pixel, 4 bytes per pixel: the triangle
+// index in the low 24 bits and the instance (draw) index in the high 8, plus
+// one so that 0 (the first-touch fill) can mean "nothing covered". Attributes
+// are fetched from the model and shaded afterwards, once per pixel.
+class VisibilityBuffer : public TiledBuffer<uint32_t>
+{
+public:
+    static constexpr uint32_t kEmpty = 0;
+    static constexpr uint32_t kMaxTriangles = (1u << 24) - 1;
+    static constexpr uint32_t kMaxInstances = 1u << 8;
+
+    using TiledBuffer::TiledBuffer;
+
+    static uint32_t pack(uint32_t instance, uint32_t triangle)
+    {
+        return (instance << 24 | triangle) + 1;
+    }
+
+    static uint32_t instance(uint32_t id) { return (id - 1) >> 24; }
+    static uint32_t triangle(uint32_t id) { return (id - 1) & kMaxTriangles; }
+};